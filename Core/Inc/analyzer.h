@@ -36,14 +36,53 @@ extern const uint8_t POPULATED_THERM_LIST_L[NUM_THERMS_PER_CHIP];
  */
 extern const uint8_t POPULATED_THERM_LIST_H[NUM_THERMS_PER_CHIP];
 
-/* We want to make sure we aren't doing useless analysis on the same set of data since we are
- * backfilling segment data */
-#define ANALYSIS_INTERVAL VOLTAGE_WAIT_TIME
+/**
+ * @brief Steps of the analysis that are skipped when none of their inputs have new data
+ * @note segment data is backfilled between acquisitions, so most frames repeat the last one
+ */
+typedef enum {
+	ANALYSIS_STAGE_THERMS,		/* thermistor disabling and pack/segment temperatures */
+	ANALYSIS_STAGE_CELLS,		/* cell temps, OCVs, resistances, pack stats and cell current limits */
+	NUM_ANALYSIS_STAGES
+} analysis_stage_id_t;
+
+/**
+ * @brief How often an analysis stage was recomputed vs carried over from the last frame
+ */
+typedef struct {
+	uint32_t executed;
+	uint32_t skipped;
+} analysis_stage_stats_t;
 
 //#define MAX_SIZE_OF_HIST_QUEUE  300000U //bytes
 
+/* Number of frames kept behind prevbmsdata for history lookups */
+#define NUM_HISTORY_FRAMES 0
+
+/* bmsdata + prevbmsdata + history + the frame currently being filled */
+#define NUM_POOL_FRAMES (NUM_HISTORY_FRAMES + 3)
+
+/**
+ * @brief Hands out a zeroed frame from the static frame pool
+ * @note the caller owns the frame until it is handed to analyzer_push(), frames must be pushed
+ *      in the order they were acquired
+ *
+ * @return acc_data_t*
+ */
+acc_data_t* analyzer_acquire_frame();
+
+/**
+ * @brief Returns a previously pushed frame, 0 = bmsdata, 1 = prevbmsdata, etc.
+ *
+ * @param age
+ * @return acc_data_t* NULL if that frame has not been pushed yet
+ */
+acc_data_t* analyzer_get_history(uint8_t age);
+
 /**
  * @brief Pushes in a new data point if we have waited long enough
+ * @note takes ownership of a frame from analyzer_acquire_frame(), the frame stays valid until
+ *      it ages out of the pool
  *
  * @param data
  */
@@ -57,6 +96,14 @@ void analyzer_push(acc_data_t* data);
  */
 uint8_t analyzer_calc_fan_pwm();
 
+/**
+ * @brief Returns the execute and skip counts of an analysis stage
+ *
+ * @param stage
+ * @return const analysis_stage_stats_t*
+ */
+const analysis_stage_stats_t* analyzer_get_stage_stats(analysis_stage_id_t stage);
+
 /**
  * @brief Pointer to the address of the most recent data point
  */
@@ -4,6 +4,7 @@
 // Hardware definition
 #define NUM_SEGMENTS        6
 #define NUM_CHIPS           NUM_SEGMENTS* 2
+#define NUM_SPI_BUSES       1 // SPI buses the daisy chain is split across, see bus_table in segment.c
 #define NUM_CELLS_PER_CHIP  10
 #define NUM_THERMS_PER_CHIP 32
 #define NUM_RELEVANT_THERMS 3
@@ -14,10 +15,10 @@
 #define MAX_VOLT_MEAS       65535
 #define MIN_VOLT_MEAS       0
 
-// Boosting Parameters
-#define BOOST_TIME          5   // seconds
-#define BOOST_RECHARGE_TIME 30  // seconds
-#define CONTDCL_MULTIPLIER  3
+// Current limit horizons, how long each predicted limit can be held for
+#define PEAK_LIMIT_TIME     2   // seconds
+#define SHORT_LIMIT_TIME    10  // seconds
+#define CONT_LIMIT_TIME     30  // seconds
 
 //cell limits
 #define MIN_VOLT            2.5
@@ -30,15 +31,13 @@
 #define MAX_CELL_CURR       500 // Amps per BMS cell
 #define MAX_CELL_TEMP_BAL   45
 #define MAX_CHG_CELL_CURR   20
+#define PACK_CAPACITY       35 // Ah, nominal capacity of one parallel group, may need adjustment
 
 // Algorithm settings
 #define CHARGE_SETL_TIMEOUT 60000 // 1 minute, may need adjustment
 #define CHARGE_SETL_TIMEUP  300000 // 5 minutes, may need adjustment
 #define CHARGE_VOLT_TIMEOUT 300000 // 5 minutes, may need adjustment
 #define VOLT_SAG_MARGIN     0.45 // Volts above the minimum cell voltage we would like to aim for
-#define OCV_CURR_THRESH     1.5
-
-#define OCV_AVG             3
 
 #define MAX_STANDARD_DEV    3 // only used for standard deviation for therms calc
 
@@ -0,0 +1,45 @@
+#ifndef CELL_RES_H
+#define CELL_RES_H
+
+#include <stdint.h>
+
+/* Fraction bits of the scales cell_res_get_scale() and cell_res_get_inv_scale() return */
+#define CELL_RES_SCALE_Q 8
+
+/* Pack current steps smaller than this (A) don't move the cell voltages clear of their noise */
+#define CELL_RES_MIN_STEP 10
+
+/**
+ * @brief Starts every cell's estimate over at the resistance table
+ */
+void cell_res_init();
+
+/**
+ * @brief Feeds one cell's voltage response to a step in pack current into its resistance estimate
+ * @note both steps have to be taken between the same two cell voltage readings
+ *
+ * @param cell index into the pack wide cell arrays, see CELL_INDEX()
+ * @param current_step A the discharge current moved by, at least CELL_RES_MIN_STEP either way
+ * @param voltage_step V the cell voltage moved by
+ * @param table_r0 Ohms the resistance table gives at the cell's temperature
+ */
+void cell_res_update(uint8_t cell, float current_step, float voltage_step, float table_r0);
+
+/**
+ * @brief Returns how the cell's resistance compares to the table, 1 << CELL_RES_SCALE_Q until the
+ *      estimate has seen enough current steps to be trusted
+ *
+ * @param cell
+ * @return uint16_t estimated over table resistance, Q CELL_RES_SCALE_Q
+ */
+uint16_t cell_res_get_scale(uint8_t cell);
+
+/**
+ * @brief Returns the reciprocal of cell_res_get_scale(), for scaling conductances without dividing
+ *
+ * @param cell
+ * @return uint16_t table over estimated resistance, Q CELL_RES_SCALE_Q
+ */
+uint16_t cell_res_get_inv_scale(uint8_t cell);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef CELL_STATS_H
+#define CELL_STATS_H
+
+#include <stdint.h>
+
+/**
+ * @brief Min, max and sum over an array of unsigned cell values (voltages, OCVs)
+ * @note indices are of the first occurrence
+ */
+typedef struct {
+	uint16_t min;
+	uint16_t max;
+	uint8_t min_index;
+	uint8_t max_index;
+	uint32_t sum;
+} cell_stats_u16_t;
+
+/**
+ * @brief Min, max and sum over an array of signed cell values (temperatures)
+ * @note indices are of the first occurrence
+ */
+typedef struct {
+	int8_t min;
+	int8_t max;
+	uint8_t min_index;
+	uint8_t max_index;
+	int32_t sum;
+} cell_stats_s8_t;
+
+/**
+ * @brief Reduces an array of uint16_t values, two at a time with the Cortex-M4 SIMD instructions
+ *
+ * @param vals
+ * @param num number of values, at least 1
+ * @param stats
+ */
+void cell_stats_u16(const uint16_t* vals, uint8_t num, cell_stats_u16_t* stats);
+
+/**
+ * @brief Reduces an array of int8_t values, four at a time with the Cortex-M4 SIMD instructions
+ *
+ * @param vals
+ * @param num number of values, at least 1
+ * @param stats
+ */
+void cell_stats_s8(const int8_t* vals, uint8_t num, cell_stats_s8_t* stats);
+
+#endif
@@ -77,21 +77,40 @@ bool compute_charger_connected();
 uint8_t compute_set_fan_speed(TIM_HandleTypeDef* pwmhandle, fan_select_t fan_select, uint8_t duty_cycle);
 
 /**
- * @brief Returns the pack current sensor reading
+ * @brief Returns the duty cycle a fan was last set to
+ *
+ * @param fan_select
+ * @return uint8_t duty cycle in %, 0 if the fan was never set
+ */
+uint8_t compute_get_fan_speed(fan_select_t fan_select);
+
+/**
+ * @brief Returns the latest pack current sensor reading, averaged over the last 4 ms of
+ *      samples. Does not touch the ADC, which is sampled in the background
  *
  * @return int16_t
  */
 int16_t compute_get_pack_current();
 
 /**
- * @brief sends max discharge current to Motor Controller
+ * @brief Returns the generation of the pack current, bumped whenever compute_get_pack_current()
+ *      reads a different value than it did last time
+ *
+ * @return uint16_t
+ */
+uint16_t compute_get_current_generation();
+
+/**
+ * @brief sends max discharge current to Motor Controller, followed by what can be held for
+ *      SHORT_LIMIT_TIME and CONT_LIMIT_TIME
  *
  * @param bmsdata
  */
 void compute_send_mc_discharge_message(acc_data_t* bmsdata);
 
 /**
- * @brief sends max charge/discharge current to Motor Controller
+ * @brief sends max charge current to Motor Controller, followed by what can be held for
+ *      SHORT_LIMIT_TIME and CONT_LIMIT_TIME
  *
  * @param bmsdata
  */
@@ -192,4 +211,12 @@ void compute_send_segment_temp_message(acc_data_t* bmsdata);
 void compute_send_fault_message(uint8_t status, int16_t curr, int16_t in_dcl);
 void compute_send_voltage_noise_message(acc_data_t* bmsdata);
 
+/**
+ * @brief sends the isoSPI link health of a single chip
+ *
+ * @param chip
+ * @param stats
+ */
+void compute_send_link_stats_message(uint8_t chip, const link_stats_t* stats);
+
 #endif // COMPUTE_H
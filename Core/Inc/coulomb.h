@@ -0,0 +1,79 @@
+#ifndef COULOMB_H
+#define COULOMB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * What is kept in the COULOMBS partition, in mC so it doesn't depend on the sample rate.
+ * eepromInit() sizes the partition by it
+ */
+typedef struct {
+	int64_t discharged;
+	int64_t charged;
+	uint32_t magic;
+	uint32_t check;
+} coulomb_record_t;
+
+/**
+ * @brief Loads the charge counted before the last power cycle out of EEPROM
+ * @note eepromInit() has to be called first
+ *
+ * @param sample_rate rate coulomb_add_sample() is called at in Hz, set by the hardware sample timer
+ */
+void coulomb_init(uint32_t sample_rate);
+
+/**
+ * @brief Counts one pack current sample, positive is discharge, less the sensor's zero offset
+ * @note called from the current sampling interrupt for every scan
+ *
+ * @param current in mA
+ */
+void coulomb_add_sample(int32_t current);
+
+/**
+ * @brief Tells the counter whether the pack is known to be disconnected, ex. while the BMS holds
+ *      the shutdown circuit open, so anything the sensor reads then is its zero offset
+ *
+ * @param is_open
+ */
+void coulomb_set_open(bool is_open);
+
+/**
+ * @brief Returns the sensor zero offset being taken out of every sample
+ *
+ * @return int32_t mA
+ */
+int32_t coulomb_get_offset();
+
+/**
+ * @brief Returns the charge drawn from the pack since it was first counted
+ *
+ * @return uint32_t mAh
+ */
+uint32_t coulomb_get_discharged();
+
+/**
+ * @brief Returns the charge put into the pack since it was first counted
+ *
+ * @return uint32_t mAh
+ */
+uint32_t coulomb_get_charged();
+
+/**
+ * @brief Returns the charge drawn from the pack less the charge put in, finer than the mAh totals
+ *      so short intervals can be told apart
+ * @note wraps, only the difference between two readings means anything
+ *
+ * @return uint32_t mAs
+ */
+uint32_t coulomb_get_net_mas();
+
+/**
+ * @brief Writes the counted charge to EEPROM once enough has moved since the last save, at most
+ *      once every COULOMB_SAVE_INTERVAL
+ * @note blocks for the EEPROM write when it does save
+ */
+void coulomb_save();
+
+#endif
@@ -6,6 +6,11 @@
 #include "bmsConfig.h"
 #include "timer.h"
 
+#define NUM_CELLS (NUM_CHIPS * NUM_CELLS_PER_CHIP)
+
+/* Position of a chip's cell in the pack-wide cell arrays of acc_data_t */
+#define CELL_INDEX(chip, cell) ((chip) * NUM_CELLS_PER_CHIP + (cell))
+
 /**
  * @brief Individual chip data
  * @note stores thermistor values, voltage readings, and the discharge status
@@ -17,15 +22,52 @@ typedef struct {
 	int8_t thermistor_value[NUM_THERMS_PER_CHIP];
 	int error_reading;
 
-	/* These are calculated during the analysis of data */
-	int8_t cell_temp[NUM_CELLS_PER_CHIP];
-	float cell_resistance[NUM_CELLS_PER_CHIP];
-	uint16_t open_cell_voltage[NUM_CELLS_PER_CHIP];
-
 	uint8_t noise_reading[NUM_CELLS_PER_CHIP]; /* bool representing noise ignored read */
 	uint8_t consecutive_noise[NUM_CELLS_PER_CHIP]; /* count representing consecutive noisy reads */
+
+	/* How many acquisitions in a row have failed to get fresh data off of this chip, 0 if current */
+	uint8_t voltage_stale_age;
+	uint8_t therm_stale_age;
+	uint8_t stale_groups; /* bit per cell voltage register group carried over from the last good read */
 } chipdata_t;
 
+/**
+ * @brief Health of the isoSPI link to a single chip
+ * @note counters wrap, compare against an earlier snapshot to get rates
+ */
+typedef struct {
+	uint16_t pec_errors;		  /* register group reads that failed PEC */
+	uint16_t retries;			  /* register group re-reads issued after a PEC failure */
+	uint8_t consecutive_failures; /* acquisitions in a row that left at least one group stale */
+	uint16_t bad_reads;			  /* thermistor reads that came back as LTC_BAD_READ */
+	uint16_t substituted_cells;	  /* out of range voltages replaced with the last good read */
+	uint32_t last_good;			  /* tick of the last acquisition with every group through PEC */
+} link_stats_t;
+
+/**
+ * @brief Sources of the data that goes into a frame
+ * @note each source keeps a generation counter that it bumps whenever it brings in new data, the
+ *      frame carries the generation its data came from so analysis can tell what actually changed
+ */
+typedef enum {
+	FRAME_SRC_VOLTAGE, /* cell voltages and noise flags, see segment_get_voltage_generation() */
+	FRAME_SRC_THERM,   /* thermistor readings, see segment_get_therm_generation() */
+	FRAME_SRC_CURRENT, /* pack current, see compute_get_current_generation() */
+	NUM_FRAME_SOURCES
+} frame_source_t;
+
+#define FRAME_SRC_BIT(src) (1 << (src))
+
+/**
+ * @brief How long the predicted current limits of a frame hold for, see the *_LIMIT_TIME settings
+ */
+typedef enum {
+	LIMIT_PEAK,	 /* PEAK_LIMIT_TIME, what discharge_limit and charge_limit are held to */
+	LIMIT_SHORT, /* SHORT_LIMIT_TIME */
+	LIMIT_CONT,	 /* CONT_LIMIT_TIME, also held to the continuous ratings */
+	NUM_LIMIT_HORIZONS
+} limit_horizon_t;
+
 /**
  * @brief Enuemrated possible fault codes for the BMS
  * @note  the values increase at powers of two to perform bitwise operations on a main fault code
@@ -79,9 +121,23 @@ typedef struct {
 	/* Array of data from all chips in the system */
 	chipdata_t chip_data[NUM_CHIPS];
 
+	/*
+	 * Pack-wide per cell values, laid out by CELL_INDEX() so the analysis can run over every
+	 * cell in one pass. cell_voltage is gathered from chip_data, the rest are calculated
+	 */
+	uint16_t cell_voltage[NUM_CELLS];
+	uint16_t cell_ocv[NUM_CELLS];
+	int8_t cell_temp[NUM_CELLS];
+	uint16_t cell_resistance[NUM_CELLS]; /* mOhm in Q8.8 */
+
+	/* Generation of each frame_source_t the data in this frame was taken from */
+	uint16_t generation[NUM_FRAME_SOURCES];
+	uint32_t timestamp; /* HAL tick the frame was collected at, ms */
+
 	int fault_status;
 
 	int16_t pack_current; /* this value is multiplied by 10 to account for decimal precision */
+	int16_t voltage_current; /* pack_current when the last cell conversion started, matches cell_voltage on a new voltage generation */
 	uint16_t pack_voltage;
 	uint16_t pack_ocv;
 	uint16_t pack_res;
@@ -90,7 +146,19 @@ typedef struct {
 	uint16_t charge_limit;
 	uint16_t cont_DCL;
 	uint16_t cont_CCL;
+
+	/* Most current the weakest cell can hold over each limit_horizon_t, A */
+	uint16_t dcl_horizon[NUM_LIMIT_HORIZONS];
+	uint16_t ccl_horizon[NUM_LIMIT_HORIZONS];
+
 	uint8_t soc;
+	uint8_t soc_bound; /* +- % the soc could be off by, two standard deviations */
+	uint16_t pack_ah; /* charge left in the pack, Ah * 10 */
+
+	/* Coulomb counter totals, mAh */
+	uint32_t discharged;
+	uint32_t charged;
+	uint32_t net_discharged; /* mAs, wraps, see coulomb_get_net_mas() */
 
 	int8_t segment_average_temps[NUM_SEGMENTS];
 	uint8_t segment_noise_percentage[NUM_SEGMENTS];
@@ -105,6 +173,11 @@ typedef struct {
 	crit_cellval_t min_temp;
 	int8_t avg_temp;
 
+	/* Hottest and coldest cell temperatures the thermal model expects, ahead of the thermistors */
+	crit_cellval_t est_max_temp;
+	crit_cellval_t est_min_temp;
+	uint8_t fan_duty[NUM_SEGMENTS]; /* % PWM of the fan cooling each segment */
+
 	/* Max and min cell resistances */
 	crit_cellval_t max_res;
 	crit_cellval_t min_res;
@@ -120,11 +193,15 @@ typedef struct {
 	uint16_t avg_ocv;
 	uint16_t delt_ocv;
 
-	uint16_t boost_setting;
-
 	bool is_charger_connected;
 } acc_data_t;
 
+/* Per chip access into the pack-wide cell arrays */
+#define CELL_VOLTAGE(acc, chip, cell) ((acc)->cell_voltage[CELL_INDEX(chip, cell)])
+#define CELL_OCV(acc, chip, cell)	  ((acc)->cell_ocv[CELL_INDEX(chip, cell)])
+#define CELL_TEMP(acc, chip, cell)	  ((acc)->cell_temp[CELL_INDEX(chip, cell)])
+#define CELL_RES(acc, chip, cell)	  ((acc)->cell_resistance[CELL_INDEX(chip, cell)])
+
 /**
  * @brief Represents individual BMS states
  */
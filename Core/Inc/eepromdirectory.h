@@ -6,11 +6,11 @@
 #include <stdbool.h>
 
 #define NUM_EEPROM_FAULTS 5
-#define NUM_EEPROM_ITEMS  2
+#define NUM_EEPROM_ITEMS  3
 #define EEPROM_ROOT_ADDR  0
 
 /* index 0 = newest, index 4 = oldest */
-static uint32_t eeprom_faults[NUM_EEPROM_FAULTS];
+extern uint32_t eeprom_faults[NUM_EEPROM_FAULTS];
 
 struct eeprom_partition 
 {
@@ -19,7 +19,7 @@ struct eeprom_partition
     uint16_t address;     /* start address */
 };
 
-struct eeprom_partition eeprom_data[NUM_EEPROM_ITEMS];
+extern struct eeprom_partition eeprom_data[NUM_EEPROM_ITEMS];
 /*  ____________KEY________________         _BYTES_   */
   
 
@@ -0,0 +1,167 @@
+#ifndef LTC_DMA_H
+#define LTC_DMA_H
+
+#include "stm32f4xx_hal.h"
+#include "bmsConfig.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LTC_DMA_CMD_LEN		 4 /* 2 command bytes + 2 PEC bytes */
+#define LTC_DMA_BYTES_PER_IC 8 /* 6 register bytes + 2 PEC bytes */
+#define LTC_DMA_MAX_CMDS	 5 /* enough for RDCVA through RDCVD plus RDAUXA */
+#define LTC_DMA_MAX_BUSES	 3
+
+/* Size of a single read transaction, the first LTC_DMA_CMD_LEN bytes are clocked out while sending the command */
+#define LTC_DMA_XFER_LEN (LTC_DMA_CMD_LEN + NUM_CHIPS * LTC_DMA_BYTES_PER_IC)
+
+/* LTC6804 read commands */
+#define LTC_CMD_RDCFG  0x0002
+#define LTC_CMD_RDCVA  0x0004
+#define LTC_CMD_RDCVB  0x0006
+#define LTC_CMD_RDCVC  0x0008
+#define LTC_CMD_RDCVD  0x000A
+#define LTC_CMD_RDAUXA 0x000C
+#define LTC_CMD_RDAUXB 0x000E
+
+/* Converts all cells plus GPIO1 and GPIO2 in one go, results land in the cell and aux A groups */
+#define LTC_CMD_ADCVAX(md, dcp) (0x046F | ((md) << 7) | ((dcp) << 4))
+
+/**
+ * @brief One completed readback, the response to each queued command for every chip on the bus
+ */
+typedef struct {
+	uint8_t rx[LTC_DMA_MAX_CMDS][LTC_DMA_XFER_LEN];
+	uint8_t num_cmds;
+	uint32_t sequence; /* incremented for every completed frame */
+} ltc_dma_frame_t;
+
+/**
+ * @brief Timing of the last completed frame, in CPU cycles
+ */
+typedef struct {
+	uint32_t bytes;		 /* bytes clocked over SPI for the frame */
+	uint32_t bus_cycles; /* cycles from starting the first transfer to the last one completing */
+	uint32_t cpu_cycles; /* cycles the CPU spent setting up transfers and servicing completions */
+	uint32_t frames;	 /* total frames completed */
+	uint32_t errors;	 /* total transfers that failed to start or errored out */
+} ltc_dma_stats_t;
+
+typedef void (*ltc_dma_callback_t)(const ltc_dma_frame_t* frame, void* ctx);
+
+/**
+ * @brief A daisy chain of LTC6804s hanging off of one SPI bus
+ */
+typedef struct {
+	SPI_HandleTypeDef* hspi;
+	GPIO_TypeDef* cs_port;
+	uint16_t cs_pin;
+	uint8_t num_chips;
+
+	uint8_t tx[LTC_DMA_XFER_LEN];
+	uint16_t cmds[LTC_DMA_MAX_CMDS];
+	uint8_t cmd_index;
+
+	/* DMA streams into frames[fill], the other frame holds the last completed readback */
+	ltc_dma_frame_t frames[2];
+	uint8_t fill;
+	volatile bool busy;
+	volatile bool frame_ready;
+
+	ltc_dma_callback_t callback;
+	void* ctx;
+
+	uint32_t start_cycle;
+	uint32_t cpu_cycles;
+	ltc_dma_stats_t stats;
+} ltc_dma_t;
+
+/**
+ * @brief Sets up a bus for DMA transfers
+ * @note the SPI handle needs both its TX and RX DMA streams linked
+ *
+ * @param bus
+ * @param hspi
+ * @param cs_port
+ * @param cs_pin
+ * @param num_chips number of chips on this bus
+ */
+void ltc_dma_init(ltc_dma_t* bus, SPI_HandleTypeDef* hspi, GPIO_TypeDef* cs_port, uint16_t cs_pin,
+				  uint8_t num_chips);
+
+/**
+ * @brief Sets a callback that is run from the DMA ISR once a frame completes
+ *
+ * @param bus
+ * @param callback
+ * @param ctx passed back to the callback
+ */
+void ltc_dma_set_callback(ltc_dma_t* bus, ltc_dma_callback_t callback, void* ctx);
+
+/**
+ * @brief Starts streaming the response to a sequence of read commands in the background
+ *
+ * @param bus
+ * @param cmds LTC6804 read commands, ex. LTC_CMD_RDCVA
+ * @param num_cmds
+ * @return int 0 if started, -1 if the bus is busy, the chain didn't wake or the transfer could not
+ *     be started
+ */
+int ltc_dma_read(ltc_dma_t* bus, const uint16_t* cmds, uint8_t num_cmds);
+
+/**
+ * @brief Sends a command that has no data, ex. a conversion, to every chip on the bus
+ * @note this is a short polled transfer, it waits on any DMA transfer in flight first
+ *
+ * @param bus
+ * @param cmd
+ * @return int 0 on success, -1 if the SPI transfer failed
+ */
+int ltc_dma_send_command(ltc_dma_t* bus, uint16_t cmd);
+
+/**
+ * @brief Returns if a transfer is in flight
+ *
+ * @param bus
+ * @return true
+ * @return false
+ */
+bool ltc_dma_busy(ltc_dma_t* bus);
+
+/**
+ * @brief Blocks until the transfer in flight is done, call before any polled access to the same SPI bus
+ *
+ * @param bus
+ */
+void ltc_dma_wait(ltc_dma_t* bus);
+
+/**
+ * @brief Returns the most recently completed frame if it hasn't been fetched yet
+ * @note the frame stays valid until the next ltc_dma_read() completes
+ *
+ * @param bus
+ * @return const ltc_dma_frame_t* NULL if there is no new frame
+ */
+const ltc_dma_frame_t* ltc_dma_get_frame(ltc_dma_t* bus);
+
+/**
+ * @brief Returns the register data of a chip in a completed frame
+ *
+ * @param frame
+ * @param cmd index of the command in the sequence that was read
+ * @param chip position of the chip in the daisy chain
+ * @return const uint8_t* LTC_DMA_BYTES_PER_IC bytes, register data followed by the PEC
+ */
+static inline const uint8_t* ltc_dma_chip_data(const ltc_dma_frame_t* frame, uint8_t cmd, uint8_t chip)
+{
+	return &frame->rx[cmd][LTC_DMA_CMD_LEN + chip * LTC_DMA_BYTES_PER_IC];
+}
+
+/**
+ * @brief Returns the timing of the last completed frame
+ *
+ * @param bus
+ * @return const ltc_dma_stats_t*
+ */
+const ltc_dma_stats_t* ltc_dma_get_stats(ltc_dma_t* bus);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef LUT_H
+#define LUT_H
+
+#include <stdint.h>
+
+/**
+ * @brief A dense lookup table, one entry every 2^x_shift input units starting at x_min
+ * @note tables are generated from breakpoint lists by scripts/gen_luts.py, see lut_tables.h
+ */
+typedef struct {
+	int32_t x_min;	 /* input of the first entry */
+	uint8_t x_shift; /* log2 of the input units between entries */
+	uint16_t len;
+	const int16_t* y;
+} lut_t;
+
+/**
+ * @brief Returns the entry at or below x, inputs past either end saturate to the first or last
+ * @note for indexing arrays generated alongside the table
+ *
+ * @param lut
+ * @param x
+ * @return uint16_t
+ */
+static inline uint16_t lut_index(const lut_t* lut, int32_t x)
+{
+	if (x <= lut->x_min)
+		return 0;
+
+	uint32_t index = (uint32_t)(x - lut->x_min) >> lut->x_shift;
+	return index < lut->len ? index : lut->len - 1;
+}
+
+/**
+ * @brief Looks x up in a table, linearly interpolating between entries that are more than one
+ *      input unit apart. Inputs past either end saturate to the end values
+ *
+ * @param lut
+ * @param x
+ * @return int16_t
+ */
+static inline int16_t lut_lookup(const lut_t* lut, int32_t x)
+{
+	if (x <= lut->x_min)
+		return lut->y[0];
+
+	uint32_t offset = x - lut->x_min;
+	uint32_t index	= offset >> lut->x_shift;
+	if (index >= lut->len - 1u)
+		return lut->y[lut->len - 1];
+
+	/* Weight of the next entry, out of 2^x_shift */
+	int32_t frac = offset & ((1u << lut->x_shift) - 1);
+	int32_t step = lut->y[index + 1] - lut->y[index];
+
+	return lut->y[index] + ((step * frac) >> lut->x_shift);
+}
+
+#endif
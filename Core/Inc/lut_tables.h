@@ -0,0 +1,38 @@
+/* Generated by scripts/gen_luts.py from the curves in it, do not edit */
+
+#ifndef LUT_TABLES_H
+#define LUT_TABLES_H
+
+#include "lut.h"
+
+#define CELL_RES_Q		8 /* fraction bits of CELL_RES_LUT */
+#define CELL_RECIP_Q	24 /* fraction bits of CELL_RES_RECIP */
+#define THERM_RATIO_Q	12 /* fraction bits of the THERM_LUT input */
+#define SOC_Q			12 /* fraction bits of the OCV_LUT input */
+
+/* Cell resistance in mOhm (Q8.8) by cell temperature in C */
+extern const lut_t CELL_RES_LUT;
+
+/* Continuous discharge current limit in A by temperature in C */
+extern const lut_t CONT_DCL_LUT;
+
+/* Continuous charge current limit in A by temperature in C */
+extern const lut_t CONT_CCL_LUT;
+
+/* Fan PWM out of 255 by temperature in C */
+extern const lut_t FAN_LUT;
+
+/* State of charge in % by open cell voltage in 0.1mV, 3.2mV per entry */
+extern const lut_t SOC_LUT;
+
+/* Open cell voltage in mV by state of charge in Q12, 16 per entry */
+extern const lut_t OCV_LUT;
+
+/* Thermistor temperature in 0.1C by its divider ratio to the ref in Q12 */
+extern const lut_t THERM_LUT;
+
+/* Reciprocal of 10x the resistance at each CELL_RES_LUT entry in Q24, index with
+ * lut_index(&CELL_RES_LUT, temp) */
+extern const uint32_t CELL_RES_RECIP[91];
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef PEC15_H
+#define PEC15_H
+
+#include <stdint.h>
+
+#define PEC15_DATA_LEN	 6 /* register bytes per chip covered by the PEC */
+#define PEC15_REG_STRIDE 8 /* register bytes plus the PEC, per chip in a daisy chain response */
+
+/**
+ * @brief Calculates the LTC6804 PEC15 over a buffer, two bytes per table step
+ * @note drop in replacement for pec15_calc()
+ *
+ * @param len
+ * @param data
+ * @return uint16_t PEC, sent MSB first
+ */
+uint16_t pec15_compute(uint8_t len, const uint8_t* data);
+
+/**
+ * @brief Checks the PEC of every chip in a daisy chain response
+ *
+ * @param buf response with PEC15_REG_STRIDE bytes per chip, starting at the first chip
+ * @param num_chips
+ * @param failed_mask set to a bit per chip whose PEC didn't match, bit 0 is the first chip
+ * @return uint8_t number of chips that failed
+ */
+uint8_t pec15_verify_chain(const uint8_t* buf, uint8_t num_chips, uint32_t* failed_mask);
+
+#endif
@@ -5,6 +5,24 @@
 #include "bmsConfig.h"
 #include "datastructs.h"
 
+/**
+ * @brief How cell and thermistor voltages are converted
+ */
+typedef enum {
+	SEGMENT_ACQ_SEPARATE, /* ADCV for cells, ADAX for thermistors, each with their own readback */
+	SEGMENT_ACQ_COMBINED, /* ADCVAX converts cells and GPIO1/2 together, one readback for both */
+	SEGMENT_ACQ_NUM_MODES
+} segment_acq_mode_t;
+
+/**
+ * @brief Cost of one full frame, a set of cell voltages plus one thermistor mux channel
+ */
+typedef struct {
+	uint32_t bytes;		 /* SPI bytes for the conversion commands and readbacks */
+	uint32_t latency_us; /* from the first conversion command until the data was decoded */
+	uint32_t frames;	 /* frames completed in this mode */
+} segment_acq_stats_t;
+
 /**
  * @brief Initializes the segments
  */
@@ -12,13 +30,86 @@ void segment_init();
 
 /**
  * @brief Pulls all cell data from the segments and returns all cell data
- *
- * @todo make sure that retrieving cell data doesn't block code too much
+ * @note equivalent to segment_start_conversion() followed by segment_collect()
  *
  * @return int*
  */
 void segment_retrieve_data(chipdata_t databuf[NUM_CHIPS]);
 
+/**
+ * @brief Broadcasts a cell voltage conversion if the sample period is up and nothing is in flight
+ * @note the conversion runs on the chips, so the caller is free to do other work until segment_collect()
+ *
+ * @return true if a conversion was started, false if it wasn't time yet or the command didn't go out
+ * @return false
+ */
+bool segment_start_conversion();
+
+/**
+ * @brief Advances any conversion in flight and fills the buffer with the latest cell data,
+ * anything that isn't ready yet is carried over from the last reading
+ *
+ * @param databuf
+ */
+void segment_collect(chipdata_t databuf[NUM_CHIPS]);
+
+/**
+ * @brief Sets the ADC speed for all following conversions
+ * @note conversion waits are scheduled off of the datasheet conversion time for the mode
+ *
+ * @param md MD_FAST (27kHz), MD_NORMAL (7kHz) or MD_FILTERED (26Hz)
+ * @param dcp DCP_ENABLED to keep balancing through conversions, DCP_DISABLED to pause it
+ */
+void segment_set_adc_mode(uint8_t md, uint8_t dcp);
+
+/**
+ * @brief Returns how long a cell voltage conversion takes in a mode
+ *
+ * @param md
+ * @return uint32_t conversion time in us
+ */
+uint32_t segment_get_conversion_time(uint8_t md);
+
+/**
+ * @brief Returns the link health counters of a chip
+ *
+ * @param chip index of the chip, same as in chipdata_t arrays
+ * @return const link_stats_t*
+ */
+const link_stats_t* segment_get_link_stats(uint8_t chip);
+
+/**
+ * @brief Switches between separate and combined cell/thermistor conversions
+ * @note takes effect on the next conversion, anything in flight finishes the old way
+ *
+ * @param mode
+ */
+void segment_set_acq_mode(segment_acq_mode_t mode);
+
+/**
+ * @brief Returns the cost of the last full frame taken in a mode
+ *
+ * @param mode
+ * @return const segment_acq_stats_t*
+ */
+const segment_acq_stats_t* segment_get_acq_stats(segment_acq_mode_t mode);
+
+/**
+ * @brief Returns the generation of the cell voltages, bumped every time a voltage acquisition completes
+ * @note a frame collected while nothing new came in only holds carried over voltages and keeps the
+ *      same generation
+ *
+ * @return uint16_t
+ */
+uint16_t segment_get_voltage_generation();
+
+/**
+ * @brief Returns the generation of the thermistor readings, bumped every time a mux channel is read
+ *
+ * @return uint16_t
+ */
+uint16_t segment_get_therm_generation();
+
 /**
  * @brief Enables/disables balancing for all cells
  *
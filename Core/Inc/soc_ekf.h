@@ -0,0 +1,92 @@
+#ifndef SOC_EKF_H
+#define SOC_EKF_H
+
+#include <stdint.h>
+
+/**
+ * @brief Extended Kalman filter state of charge estimate for one cell
+ * @note the cell is modelled as its OCV curve, a series resistance and one RC pair, see soc_ekf.c
+ */
+typedef struct {
+	float soc;	/* 0 to 1 */
+	float v_rc; /* V across the RC pair, adds to the drop across the series resistance */
+
+	/* Covariance of (soc, v_rc), it is symmetric so the off diagonal is only kept once */
+	float p_soc;
+	float p_cross;
+	float p_rc;
+} soc_ekf_t;
+
+/**
+ * @brief How long a current is held for when predicting a limit, see soc_ekf_horizon_init()
+ */
+typedef struct {
+	float time;		   /* s */
+	float decay;	   /* how much of the RC pair's voltage is left after time */
+	float rc_gain;	   /* R0 plus what the RC pair adds by the end, over R0 */
+	float charge_time; /* time over the cell capacity, 1 / As, scales the OCV slope */
+} soc_ekf_horizon_t;
+
+/**
+ * @brief Starts a filter at a SOC taken from the OCV lookup, with the RC pair at rest
+ *
+ * @param ekf
+ * @param soc 0 to 1
+ */
+void soc_ekf_init(soc_ekf_t* ekf, float soc);
+
+/**
+ * @brief Moves the estimate forward by the charge the coulomb counter saw
+ *
+ * @param ekf
+ * @param charge As drawn from the cell over dt, negative while charging
+ * @param dt s since the last prediction
+ * @param r0 series resistance in Ohms, the RC pair scales with it
+ */
+void soc_ekf_predict(soc_ekf_t* ekf, float charge, float dt, float r0);
+
+/**
+ * @brief Corrects the estimate with a measured cell voltage
+ *
+ * @param ekf
+ * @param voltage measured cell voltage in V
+ * @param current A at the time of the measurement, positive is discharge
+ * @param r0 series resistance in Ohms
+ */
+void soc_ekf_correct(soc_ekf_t* ekf, float voltage, float current, float r0);
+
+/**
+ * @brief Returns how far the true SOC could be from the estimate, two standard deviations
+ *
+ * @param ekf
+ * @return float 0 to 1
+ */
+float soc_ekf_bound(const soc_ekf_t* ekf);
+
+/**
+ * @brief Sets up a horizon for soc_ekf_current_limits(), so everything that only depends on its
+ *      length is worked out once
+ *
+ * @param horizon
+ * @param time s the current is held for
+ */
+void soc_ekf_horizon_init(soc_ekf_horizon_t* horizon, float time);
+
+/**
+ * @brief Finds the largest constant discharge and charge currents the cell can hold for each
+ *      horizon without its voltage crossing floor or ceiling at any point, predicted from the
+ *      filter's SOC and RC pair
+ *
+ * @param ekf
+ * @param r0 series resistance in Ohms
+ * @param horizons
+ * @param num_horizons
+ * @param floor V the cell may discharge down to
+ * @param ceiling V the cell may charge up to
+ * @param discharge A for each horizon, 0 if the cell is already below floor
+ * @param charge A for each horizon, 0 if the cell is already above ceiling
+ */
+void soc_ekf_current_limits(const soc_ekf_t* ekf, float r0, const soc_ekf_horizon_t* horizons, uint8_t num_horizons,
+							float floor, float ceiling, float* discharge, float* charge);
+
+#endif
@@ -62,7 +62,6 @@ void sm_handle_state(acc_data_t *bmsdata);
 * @param bms_data
 */
 void sm_balance_cells(acc_data_t *bms_data);
-void sm_broadcast_current_limit(acc_data_t *bmsdata);
 
 /**
  * @brief algorithm to calculate and set fan speed based on temperature
@@ -0,0 +1,42 @@
+#ifndef THERMAL_MODEL_H
+#define THERMAL_MODEL_H
+
+#include <stdint.h>
+
+/**
+ * @brief Lumped thermal model of one segment, its cells as a single heat capacity losing heat to
+ *      ambient through the air the fan moves
+ * @note see thermal_model.c
+ */
+typedef struct {
+	float temp; /* C, mean cell temperature of the segment */
+	float p;	/* variance of temp */
+} thermal_model_t;
+
+/**
+ * @brief Starts a model at a measured temperature
+ *
+ * @param model
+ * @param temp C
+ */
+void thermal_init(thermal_model_t* model, float temp);
+
+/**
+ * @brief Moves the model forward, holding the heat and fan duty constant over dt
+ *
+ * @param model
+ * @param heat W put into the segment's cells
+ * @param fan duty of the segment's fan, 0 to 1
+ * @param dt s since the last prediction
+ */
+void thermal_predict(thermal_model_t* model, float heat, float fan, float dt);
+
+/**
+ * @brief Corrects the model with a measured segment temperature
+ *
+ * @param model
+ * @param measured C, mean of the segment's cell temperatures
+ */
+void thermal_correct(thermal_model_t* model, float measured);
+
+#endif
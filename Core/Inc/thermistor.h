@@ -0,0 +1,39 @@
+#ifndef THERMISTOR_H
+#define THERMISTOR_H
+
+#include <stdint.h>
+#include "lut_tables.h"
+
+/**
+ * @brief Converts a thermistor reading to a temperature, by the reading's ratio to the divider's
+ *      reference. Readings at or past the reference saturate to the hot end of the table
+ * @note see "thermister decoding" in confluence in shepherd software 22A
+ *
+ * @param therm_code ADC code of the thermistor divider
+ * @param ref_code ADC code of the reference driving the divider
+ * @return int16_t temperature in 0.1C
+ */
+static inline int16_t therm_decidegrees(uint16_t therm_code, uint16_t ref_code)
+{
+	/* Outside the divider's range, treat it as being past the end of the table */
+	if (therm_code >= ref_code)
+		return lut_lookup(&THERM_LUT, 1 << THERM_RATIO_Q);
+
+	/* THERM_LUT folds the resistance of the divider into its ratio to the ref */
+	uint32_t ratio = ((uint32_t)therm_code << THERM_RATIO_Q) / ref_code;
+
+	return lut_lookup(&THERM_LUT, ratio);
+}
+
+/**
+ * @brief Rounds a temperature in 0.1C to the nearest whole degree, halves away from zero
+ *
+ * @param decidegrees
+ * @return int8_t
+ */
+static inline int8_t round_decidegrees(int16_t decidegrees)
+{
+	return (decidegrees + (decidegrees < 0 ? -5 : 5)) / 10;
+}
+
+#endif
@@ -1,85 +1,27 @@
 #include "analyzer.h"
+#include "cell_res.h"
+#include "cell_stats.h"
+#include "lut_tables.h"
+#include "soc_ekf.h"
+#include "thermal_model.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+/* Limits of the current limit equations, in the 0.1mV units of the cell voltages */
+#define DCL_VOLT_FLOOR	 ((int32_t)((MIN_VOLT + VOLT_SAG_MARGIN) * 10000 + 0.5))
+#define CCL_VOLT_CEILING ((int32_t)((MAX_VOLT - VOLT_SAG_MARGIN) * 10000 + 0.5))
 
 acc_data_t* bmsdata;
 
 acc_data_t* prevbmsdata;
 
-// clang-format off
-/**
- * @brief Mapping Cell temperature to the cell resistance based on the
- *      nominal cell resistance curve profile of the Samsung 186500 INR in the
- *      Orion BMS software utility app
- *
- * @note Units are in mOhms and indicies are in (degrees C)/5, stops at 65C
- * @note Resistance should be *interpolated* from these values (i.e. if we are
- *      at 27C, we should take the resistance that is halfway between 25C and 30C)
- */
-const float TEMP_TO_CELL_RES[14] =
-{
-	5.52 * (7/5), 4.84 * (7/5), 4.27 * (7/5), 3.68 * (7/5), 3.16 * (7/5), 2.74 * (7/5), 2.4 * (7/5),
-	2.12 * (7/5), 1.98 * (7/5), 1.92 * (7/5), 1.90 * (7/5), 1.90 * (7/5), 1.90 * (7/5), 1.90 * (7/5)
-};
-
-/**
- * @brief Mapping Cell temperatue to the discharge current limit based on the
- *      temperature discharge limit curve profile of the Samsung 186500 INR
- *      in the Orion BMS software utility app
- *
- * @note Units are in Amps and indicies are in (degrees C)/5, stops at 65C
- * @note Limit should be *interpolated* from these values (i.e. if we are
- *      at 27C, we should take the limit that is halfway between 25C and 30C)
- *
- */
-const uint8_t TEMP_TO_DCL[14] =
-{
-	110, 125, 140, 140, 140, 140,
-	140, 140, 140, 100, 60, 20, 0, 0
-};
-
-/**
- * @brief Mapping Cell temperatue to the charge current limit based on the
- *      temperature charge limit curve profile of the Samsung 186500 INR
- *      in the Orion BMS software utility app
- *
- * @note Units are in Amps and indicies are in (degrees C)/5, stops at 65C
- * @note Limit should be *interpolated* from these values (i.e. if we are
- *      at 27C, we should take the limit that is halfway between 25C and 30C)
- *
- */
-const uint8_t TEMP_TO_CCL[14] =
-{
-	0, 25, 25, 25, 25, 25, 25, 25,
-	20, 15, 10, 5, 1, 1
-};
-
-/**
- * @brief Lookup table for State of Charge
- *
- * @note each index covers 0.1V increase (voltage range is 2.9V - 4.2V, deltaV = 1.3V, 
- *      currently 13 data points)
- * @note values are unitless percentages that represent % charge
- *
- */
-const uint8_t STATE_OF_CHARGE_CURVE[18] =
-{
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 6, 15, 24, 56, 74, 85, 95, 98, 100
-};
-
-/**
- * @brief Mapping desired fan speed PWM to the cell temperature
- *
- * @note Units are in PWM out of 255 and indicies are in (degrees C)/5, stops at 65C
- * @note Limit should be *interpolated* from these values (i.e. if we are
- *      at 27C, we should take the limit that is halfway between 25C and 30C)
- */
-const uint8_t FAN_CURVE[16] =
-{
-	0, 0, 0, 0, 0, 0, 0, 0, 32, 64,
-	128, 255, 255, 255, 255, 255
-};
+/* All frames live here, nothing in the loop touches the heap */
+static acc_data_t frame_pool[NUM_POOL_FRAMES];
+static uint8_t pool_head	= 0; /* slot holding bmsdata */
+static uint8_t pool_pushed	= 0; /* number of pushed frames still held in the pool */
 
+// clang-format off
 const uint8_t NO_THERM = 0xFF;
 const uint8_t MUX_OFFSET = 16;
 
@@ -178,15 +120,109 @@ const uint8_t POPULATED_THERM_LIST_L[NUM_THERMS_PER_CHIP] =
 // clang-format on
 
 nertimer_t analysisTimer;
-nertimer_t ocvTimer;
 
 bool is_first_reading_ = true;
 
+/* Smallest per cell current limits from the fused cell pass */
+typedef struct {
+	int16_t dcl;
+	int16_t ccl;
+} cell_limits_t;
+
+/*
+ * A step of the analysis that only depends on the frame sources in inputs. When none of them
+ * have a new generation since the last frame, reuse() carries its outputs over from prevbmsdata
+ * instead of recomputing them from the same data
+ */
+typedef struct {
+	uint8_t inputs; /* FRAME_SRC_BIT() of every source the stage reads */
+	void (*run)();
+	void (*reuse)();
+} analysis_stage_t;
+
+cell_limits_t cell_limits = { 0x7FFF, 0x7FFF };
+
+/*
+ * Model based SOC of every cell. Each new set of cell voltages corrects SOC_EKF_CELLS_PER_FRAME
+ * of them in turn, which keeps the cost per frame fixed
+ */
+#define SOC_EKF_CELLS_PER_FRAME (NUM_CELLS_PER_CHIP * 2)
+soc_ekf_t cell_soc[NUM_CELLS];
+uint32_t cell_soc_discharged[NUM_CELLS]; /* net mAs discharged when each filter was last stepped */
+uint32_t cell_soc_time[NUM_CELLS];		/* ms */
+uint8_t next_soc_cell			= 0;
+uint16_t soc_voltage_generation = 0;
+bool soc_seeded					= false; /* the filters have been started from real voltages */
+
+/* Horizons the current limits are predicted over, see calc_current_limits() */
+soc_ekf_horizon_t limit_horizons[NUM_LIMIT_HORIZONS];
+
+/* What the filters predict each horizon allows, A, before the continuous ratings */
+uint16_t predicted_dcl[NUM_LIMIT_HORIZONS];
+uint16_t predicted_ccl[NUM_LIMIT_HORIZONS];
+
+/*
+ * Lumped thermal model of every segment, stepped every frame so the temperatures keep moving
+ * between thermistor readings. See calc_thermal_estimates()
+ */
+#define NUM_CELLS_PER_SEGMENT (NUM_CELLS / NUM_SEGMENTS)
+#define NUM_CHIPS_PER_SEGMENT (NUM_CHIPS / NUM_SEGMENTS)
+thermal_model_t segment_thermal[NUM_SEGMENTS];
+
+/*
+ * Each thermistor generation only brings in one mux channel, so a segment's thermistors have all
+ * been read once it has seen this many generations with all of its chips fresh
+ */
+#define THERM_SCAN_GENERATIONS (NUM_THERMS_PER_CHIP / 2)
+uint8_t segment_therm_scans[NUM_SEGMENTS];
+uint32_t thermal_time			   = 0; /* ms */
+uint16_t thermal_therm_generation = 0;
+
+/* voltage_current of the last new set of cell voltages, the current they were converted under */
+int16_t cell_voltage_current = 0;
+
+/* The SOC filters' RC pair voltages as of the last new set of cell voltages, 0.1 mV */
+int16_t cell_rc_drop[NUM_CELLS];
+
+analysis_stage_stats_t stage_stats[NUM_ANALYSIS_STAGES] = {};
+
 /* private function prototypes */
 void disable_therms();
 void high_curr_therm_check();
 void diff_curr_therm_check();
 void calc_state_of_charge();
+bool new_cell_voltages();
+void estimate_cell_resistances();
+void latch_cell_rc_drops();
+void calc_current_limits();
+void apply_current_limits();
+void calc_thermal_estimates();
+bool segment_therms_fresh(uint8_t seg);
+void gather_cell_voltages();
+void set_crit_cellval(crit_cellval_t* crit, int32_t val, uint8_t index);
+void analyze_therms();
+cell_limits_t analyze_cells();
+int32_t estimate_cell_ocv(uint8_t i);
+uint8_t changed_sources();
+void run_cell_stage();
+void calc_pack_limits();
+void reuse_therms();
+void reuse_cells();
+int16_t calc_min_cell_dcl();
+void apply_dcl(int16_t current_limit);
+int16_t calc_min_cell_ccl();
+void apply_ccl(int16_t currentLimit);
+void calc_noise_volt_percent();
+uint16_t cell_current_limit(int32_t headroom, uint32_t recip);
+#ifdef ANALYZER_REFERENCE
+void compare_reference();
+#endif
+
+const analysis_stage_t analysis_stages[NUM_ANALYSIS_STAGES] = {
+	[ANALYSIS_STAGE_THERMS] = { FRAME_SRC_BIT(FRAME_SRC_THERM), analyze_therms, reuse_therms },
+	[ANALYSIS_STAGE_CELLS]
+	= { FRAME_SRC_BIT(FRAME_SRC_VOLTAGE) | FRAME_SRC_BIT(FRAME_SRC_THERM), run_cell_stage, reuse_cells },
+};
 
 /* we are not corrctly mapping each therm reading to the correct cell. So, we are taking the average of all good readings (not disabled) for a given chip, 
  and assigning that to be the cell val for every cell in the chip*/
@@ -209,7 +245,7 @@ void calc_cell_temps()
 			}
 			//printf("\r\n");
 			/* Takes the average temperature of all the relevant thermistors */
-			bmsdata->chip_data[c].cell_temp[cell] = temp_sum / therm_count;
+			CELL_TEMP(bmsdata, c, cell) = temp_sum / therm_count;
 			therm_count = 0;
 		}
 	}
@@ -217,13 +253,6 @@ void calc_cell_temps()
 
 void calc_pack_temps()
 {
-	bmsdata->max_temp.val = MIN_TEMP;
-	bmsdata->max_temp.cellNum = 0;
-	bmsdata->max_temp.chipIndex = 0;
-
-	bmsdata->min_temp.val = MAX_TEMP;
-	bmsdata->min_temp.cellNum = 0;
-	bmsdata->min_temp.chipIndex = 0;
 	int total_temp	   = 0;
 	int total_seg_temp = 0;
 	int total_accepted  = 0;
@@ -258,136 +287,102 @@ void calc_pack_temps()
 	}
 
 
-	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
-		for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
-			if (bmsdata->chip_data[c].cell_temp[cell] > bmsdata->max_temp.val) {
-				bmsdata->max_temp.val = bmsdata->chip_data[c].cell_temp[cell];
-				bmsdata->max_temp.cellNum = cell;
-				bmsdata->max_temp.chipIndex = c;
-			}
-
-			/* finds out the minimum cell temp and location */
-			if (bmsdata->chip_data[c].cell_temp[cell] < bmsdata->min_temp.val) {
-				bmsdata->min_temp.val = bmsdata->chip_data[c].cell_temp[cell];
-				bmsdata->min_temp.cellNum = cell;
-				bmsdata->min_temp.chipIndex = c;
-			}
-		}
-	}
+	/* finds out the maximum and minimum cell temp and location */
+	cell_stats_s8_t temps;
+	cell_stats_s8(bmsdata->cell_temp, NUM_CELLS, &temps);
+	set_crit_cellval(&bmsdata->max_temp, temps.max, temps.max_index);
+	set_crit_cellval(&bmsdata->min_temp, temps.min, temps.min_index);
 
 	/* takes the average of all the cell temperatures */
 	bmsdata->avg_temp = total_temp / (total_accepted);
 }
 
-void calc_pack_voltage_stats()
+void set_crit_cellval(crit_cellval_t* crit, int32_t val, uint8_t index)
 {
-	bmsdata->max_voltage.val = MIN_VOLT_MEAS;
-	bmsdata->max_voltage.cellNum = 0;
-	bmsdata->max_voltage.chipIndex = 0;
-
-	bmsdata->max_ocv.val = MIN_VOLT_MEAS;
-	bmsdata->max_ocv.cellNum = 0;
-	bmsdata->max_ocv.chipIndex = 0;
-
-	bmsdata->min_voltage.val = MAX_VOLT_MEAS;
-	bmsdata->min_voltage.cellNum = 0;
-	bmsdata->min_voltage.chipIndex = 0;
-
-	bmsdata->min_ocv.val = MAX_VOLT_MEAS;
-	bmsdata->min_ocv.cellNum = 0;
-	bmsdata->min_ocv.chipIndex = 0;
-	
-	uint32_t total_volt	 = 0;
-	uint32_t total_ocv	 = 0;
+	crit->val		= val;
+	crit->chipIndex = index / NUM_CELLS_PER_CHIP;
+	crit->cellNum	= index % NUM_CELLS_PER_CHIP;
+}
 
+void gather_cell_voltages()
+{
+	/* The voltage readings are laid out per chip as they come off the LTCs, line them up pack-wide */
 	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
-		for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
-
-			/* fings out the maximum cell voltage and location */
-			if (bmsdata->chip_data[c].voltage[cell] > bmsdata->max_voltage.val) {
-    			bmsdata->max_voltage.val = bmsdata->chip_data[c].voltage[cell];
-    			bmsdata->max_voltage.chipIndex = c;
-    			bmsdata->max_voltage.cellNum = cell;
-			}
-
-			if (bmsdata->chip_data[c].open_cell_voltage[cell] > bmsdata->max_ocv.val) {
-    			bmsdata->max_ocv.val = bmsdata->chip_data[c].open_cell_voltage[cell];
-    			bmsdata->max_ocv.chipIndex = c;
-    			bmsdata->max_ocv.cellNum = cell;
-			}
+		memcpy(&CELL_VOLTAGE(bmsdata, c, 0), bmsdata->chip_data[c].voltage,
+			sizeof(bmsdata->chip_data[c].voltage));
+	}
+}
 
-			/* finds out the minimum cell voltage and location */
-			if (bmsdata->chip_data[c].voltage[cell] < bmsdata->min_voltage.val) {
-    			bmsdata->min_voltage.val = bmsdata->chip_data[c].voltage[cell];
-    			bmsdata->min_voltage.chipIndex = c;
-    			bmsdata->min_voltage.cellNum = cell;
-			}
+void calc_pack_voltage_stats()
+{
+	/* finds out the maximum and minimum cell voltage and location */
+	cell_stats_u16_t volts;
+	cell_stats_u16_t ocvs;
+	cell_stats_u16(bmsdata->cell_voltage, NUM_CELLS, &volts);
+	cell_stats_u16(bmsdata->cell_ocv, NUM_CELLS, &ocvs);
 
-			if (bmsdata->chip_data[c].open_cell_voltage[cell] < bmsdata->min_ocv.val) {
-    			bmsdata->min_ocv.val = bmsdata->chip_data[c].open_cell_voltage[cell];
-    			bmsdata->min_ocv.chipIndex = c;
-    			bmsdata->min_ocv.cellNum = cell;
-			}
+	set_crit_cellval(&bmsdata->max_voltage, volts.max, volts.max_index);
+	set_crit_cellval(&bmsdata->min_voltage, volts.min, volts.min_index);
+	set_crit_cellval(&bmsdata->max_ocv, ocvs.max, ocvs.max_index);
+	set_crit_cellval(&bmsdata->min_ocv, ocvs.min, ocvs.min_index);
 
-			total_volt += bmsdata->chip_data[c].voltage[cell];
-			total_ocv += bmsdata->chip_data[c].open_cell_voltage[cell];
-		}
-	}
+	uint32_t total_volt = volts.sum;
+	uint32_t total_ocv	= ocvs.sum;
 
 	/* calculate some voltage stats */
-	bmsdata->avg_voltage  = total_volt / (NUM_CELLS_PER_CHIP * NUM_CHIPS);
+	bmsdata->avg_voltage  = total_volt / NUM_CELLS;
 	bmsdata->pack_voltage = total_volt / 1000; /* convert to voltage * 10 */
 	bmsdata->delt_voltage = bmsdata->max_voltage.val - bmsdata->min_voltage.val;
 
-	bmsdata->avg_ocv  = total_ocv / (NUM_CELLS_PER_CHIP * NUM_CHIPS);
+	bmsdata->avg_ocv  = total_ocv / NUM_CELLS;
 	bmsdata->pack_ocv = total_ocv / 1000; /* convert to voltage * 10 */
 	bmsdata->delt_ocv = bmsdata->max_ocv.val - bmsdata->min_ocv.val;
 }
 
-void calc_cell_resistances()
+uint16_t cell_current_limit(int32_t headroom, uint32_t recip)
 {
-	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
-		for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
+	/* Out of headroom means no current rather than a negative one */
+	if (headroom <= 0)
+		return 0;
 
-			uint8_t cell_temp = bmsdata->chip_data[c].cell_temp[cell];
-
-			/* resistance LUT increments by 5C for each index */
-			uint8_t resIndex = (cell_temp - MIN_TEMP) / 5;
-
-			bmsdata->chip_data[c].cell_resistance[cell] = TEMP_TO_CELL_RES[resIndex];
+	return ((uint64_t)headroom * recip) >> CELL_RECIP_Q;
+}
 
-			/* Linear interpolation to more accurately represent cell resistances in between
-			 * increments of 5C */
-			if (cell_temp != MAX_TEMP) {
-				float interpolation
-					= (TEMP_TO_CELL_RES[resIndex + 1] - TEMP_TO_CELL_RES[resIndex]) / 5;
-				bmsdata->chip_data[c].cell_resistance[cell] += (interpolation * (cell_temp % 5));
-			}
-		}
+void calc_cell_resistances()
+{
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		uint32_t table = lut_lookup(&CELL_RES_LUT, bmsdata->cell_temp[i]);
+		bmsdata->cell_resistance[i] = (table * cell_res_get_scale(i)) >> CELL_RES_SCALE_Q;
 	}
 }
 
 void calc_dcl()
 {
-	static nertimer_t dcl_timer;
+	apply_dcl(calc_min_cell_dcl());
+}
 
+int16_t calc_min_cell_dcl()
+{
 	int16_t current_limit = 0x7FFF;
 
-	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
-		for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
-			/* Apply equation */
-			/* Multiplying resistance by 10 to convert from mOhm to Ohm and then to Ohm * 10000 to
-			 * account for the voltage units */
-			uint16_t tmpDCL = (bmsdata->chip_data[c].open_cell_voltage[cell]
-							   - ((MIN_VOLT + VOLT_SAG_MARGIN) * 10000))
-							  / (bmsdata->chip_data[c].cell_resistance[cell] * 10);
-
-			/* Taking the minimum DCL of all the cells */
-			if (tmpDCL < current_limit)
-				current_limit = tmpDCL;
-		}
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		/* Apply equation */
+		uint32_t recip	= ((uint64_t)CELL_RES_RECIP[lut_index(&CELL_RES_LUT, bmsdata->cell_temp[i])]
+						  * cell_res_get_inv_scale(i)) >> CELL_RES_SCALE_Q;
+		uint16_t tmpDCL = cell_current_limit(bmsdata->cell_ocv[i] - DCL_VOLT_FLOOR, recip);
+
+		/* Taking the minimum DCL of all the cells */
+		if (tmpDCL < current_limit)
+			current_limit = tmpDCL;
 	}
-	
+
+	return current_limit;
+}
+
+void apply_dcl(int16_t current_limit)
+{
+	static nertimer_t dcl_timer;
+
 	/* ceiling for current limit */
 	if (current_limit > MAX_CELL_CURR) {
 		bmsdata->discharge_limit = MAX_CELL_CURR;
@@ -440,37 +435,37 @@ void calc_dcl()
 
 void calc_cont_dcl()
 {
-	uint8_t min_res_index = (bmsdata->min_temp.val - MIN_TEMP)
-							/ 5; /* resistance LUT increments by 5C for each index */
-	uint8_t max_res_index = (bmsdata->max_temp.val - MIN_TEMP) / 5;
+	int16_t min_temp_dcl = lut_lookup(&CONT_DCL_LUT, bmsdata->est_min_temp.val);
+	int16_t max_temp_dcl = lut_lookup(&CONT_DCL_LUT, bmsdata->est_max_temp.val);
 
-	if (TEMP_TO_DCL[min_res_index] < TEMP_TO_DCL[max_res_index]) {
-		bmsdata->cont_DCL = TEMP_TO_DCL[min_res_index];
-	} else {
-		bmsdata->cont_DCL = TEMP_TO_DCL[max_res_index];
-	}
+	bmsdata->cont_DCL = min_temp_dcl < max_temp_dcl ? min_temp_dcl : max_temp_dcl;
 }
 
 void calcCCL()
+{
+	apply_ccl(calc_min_cell_ccl());
+}
+
+int16_t calc_min_cell_ccl()
 {
 	int16_t currentLimit = 0x7FFF;
 
-	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
-		for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
-			/* Apply equation */
-			uint16_t tmpCCL
-				= ((MAX_VOLT * 10000)
-				   - (bmsdata->chip_data[c].open_cell_voltage[cell] + (VOLT_SAG_MARGIN * 10000)))
-				  / (bmsdata->chip_data[c].cell_resistance[cell] * 10);
-			/* Multiplying resistance by 10 to convert from mOhm to Ohm and then to Ohm * 10000 to
-			 * account for the voltage units */
-
-			/* Taking the minimum CCL of all the cells */
-			if (tmpCCL < currentLimit)
-				currentLimit = tmpCCL;
-		}
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		/* Apply equation */
+		uint32_t recip	= ((uint64_t)CELL_RES_RECIP[lut_index(&CELL_RES_LUT, bmsdata->cell_temp[i])]
+						  * cell_res_get_inv_scale(i)) >> CELL_RES_SCALE_Q;
+		uint16_t tmpCCL = cell_current_limit(CCL_VOLT_CEILING - bmsdata->cell_ocv[i], recip);
+
+		/* Taking the minimum CCL of all the cells */
+		if (tmpCCL < currentLimit)
+			currentLimit = tmpCCL;
 	}
 
+	return currentLimit;
+}
+
+void apply_ccl(int16_t currentLimit)
+{
 	/* ceiling for current limit */
 	if (currentLimit > MAX_CHG_CELL_CURR) {
 		bmsdata->charge_limit = MAX_CHG_CELL_CURR;
@@ -481,15 +476,10 @@ void calcCCL()
 
 void calc_cont_ccl()
 {
-	uint8_t min_res_index = (bmsdata->min_temp.val - MIN_TEMP)
-							/ 5; /* resistance LUT increments by 5C for each index */
-	uint8_t max_res_index = (bmsdata->max_temp.val - MIN_TEMP) / 5;
+	int16_t min_temp_ccl = lut_lookup(&CONT_CCL_LUT, bmsdata->est_min_temp.val);
+	int16_t max_temp_ccl = lut_lookup(&CONT_CCL_LUT, bmsdata->est_max_temp.val);
 
-	if (TEMP_TO_CCL[min_res_index] < TEMP_TO_CCL[max_res_index]) {
-		bmsdata->cont_CCL = TEMP_TO_CCL[min_res_index];
-	} else {
-		bmsdata->cont_CCL = TEMP_TO_CCL[max_res_index];
-	}
+	bmsdata->cont_CCL = min_temp_ccl < max_temp_ccl ? min_temp_ccl : max_temp_ccl;
 
 	if (bmsdata->cont_CCL > MAX_CHG_CELL_CURR){
 		bmsdata->cont_CCL = MAX_CHG_CELL_CURR;
@@ -498,80 +488,221 @@ void calc_cont_ccl()
 
 void calc_open_cell_voltage()
 {
-	/* if there is no previous data point, set inital open cell voltage to current reading */
-	if (is_first_reading_) {
-		for (uint8_t chip = 0; chip < NUM_CHIPS; chip++) {
-			for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
-				bmsdata->chip_data[chip].open_cell_voltage[cell]
-					= bmsdata->chip_data[chip].voltage[cell];
-			}
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		int32_t ocv = estimate_cell_ocv(i);
+
+		/* Out of range estimates keep the previous OCV, unless there isn't one yet */
+		if (ocv <= MAX_VOLT * 10000 && ocv >= MIN_VOLT * 10000)
+			bmsdata->cell_ocv[i] = ocv;
+		else if (is_first_reading_)
+			bmsdata->cell_ocv[i] = bmsdata->cell_voltage[i];
+		else
+			bmsdata->cell_ocv[i] = prevbmsdata->cell_ocv[i];
+	}
+}
+
+int32_t estimate_cell_ocv(uint8_t i)
+{
+	/* Drop across the series resistance, A by mOhm in Q CELL_RES_Q is mV in the same Q */
+	int32_t ir_drop = (int32_t)cell_voltage_current * bmsdata->cell_resistance[i] * 10 / (1 << CELL_RES_Q);
+
+	/* And across the RC pair, which the SOC filter tracks as it relaxes after the current moves */
+	return bmsdata->cell_voltage[i] + ir_drop + cell_rc_drop[i];
+}
+
+void analyze_therms()
+{
+	int8_t tmp_temp = 25; /* Iniitalize to room temp (necessary to stabilize when the BMS first boots up/has null values) */
+	if (!is_first_reading_) tmp_temp = prevbmsdata->avg_temp; /* Set to actual average temp of the pack */
+
+	int total_temp	   = 0;
+	int total_seg_temp = 0;
+	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+		const int8_t* readings = bmsdata->chip_data[c].thermistor_reading;
+		int8_t* values		   = bmsdata->chip_data[c].thermistor_value;
+
+		for (uint8_t therm = 0; therm < NUM_THERMS_PER_CHIP; therm++) {
+			/* Disabled therms are nullified by setting them to the pack average */
+			values[therm] = THERM_DISABLE[c][therm] ? tmp_temp : readings[therm];
+			total_temp += values[therm];
+			total_seg_temp += values[therm];
+		}
+
+		/* only for NERO, grouped the same as calc_pack_temps() */
+		if (c % 2 == 0) {
+			bmsdata->segment_average_temps[c / 2] = total_seg_temp / 22;
+			total_seg_temp						  = 0;
 		}
-		return;
 	}
-	/* If we are within the current threshold for open voltage measurments */
-	else if (bmsdata->pack_current < (OCV_CURR_THRESH * 10)
-			 && bmsdata->pack_current > (-OCV_CURR_THRESH * 10)) {
-		if (is_timer_expired(&ocvTimer) || !is_timer_active(&ocvTimer)) {
-			for (uint8_t chip = 0; chip < NUM_CHIPS; chip++) {
-				for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
-					/* Sets open cell voltage to a moving average of OCV_AVG values */
-					bmsdata->chip_data[chip].open_cell_voltage[cell]
-						= ((uint32_t)(bmsdata->chip_data[chip].voltage[cell])
-						   + ((uint32_t)(prevbmsdata->chip_data[chip].open_cell_voltage[cell])
-							  * (OCV_AVG - 1)))
-						  / OCV_AVG;
-					bmsdata->chip_data[chip].open_cell_voltage[cell]
-						= bmsdata->chip_data[chip].voltage[cell];
-
-					if (bmsdata->chip_data[chip].open_cell_voltage[cell] > MAX_VOLT * 10000) {
-						bmsdata->chip_data[chip].open_cell_voltage[cell]
-							= prevbmsdata->chip_data[chip].open_cell_voltage[cell];
-					} else if (bmsdata->chip_data[chip].open_cell_voltage[cell]
-							   < MIN_VOLT * 10000) {
-						bmsdata->chip_data[chip].open_cell_voltage[cell]
-							= prevbmsdata->chip_data[chip].open_cell_voltage[cell];
-					}
+
+	bmsdata->avg_temp = total_temp / (NUM_CHIPS * NUM_THERMS_PER_CHIP);
+}
+
+cell_limits_t analyze_cells()
+{
+	cell_limits_t limits = { 0x7FFF, 0x7FFF };
+	uint8_t max_volt = 0, min_volt = 0, max_ocv = 0, min_ocv = 0, max_temp = 0, min_temp = 0;
+	uint32_t total_volt = 0;
+	uint32_t total_ocv	= 0;
+	uint8_t noise_count[NUM_SEGMENTS] = {};
+
+	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+		const int8_t* therm_values = bmsdata->chip_data[c].thermistor_value;
+		const uint8_t (*therm_map)[NUM_RELEVANT_THERMS] = (c % 2 == 0) ? RELEVANT_THERM_MAP_L : RELEVANT_THERM_MAP_H;
+
+		for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
+			uint8_t i = CELL_INDEX(c, cell);
+
+			/* Cell temp, see calc_cell_temps() */
+			uint8_t therm_count = 0;
+			int temp_sum		= 0;
+			for (uint8_t therm = 0; therm < NUM_RELEVANT_THERMS; therm++) {
+				if (therm_map[cell][therm] != NO_THERM) {
+					temp_sum += therm_values[therm];
+					therm_count++;
 				}
 			}
-			return;
+			bmsdata->cell_temp[i] = temp_sum / therm_count;
+
+			/* Cell resistance, the table at the cell's temperature scaled by its online estimate */
+			uint16_t res_index			= lut_index(&CELL_RES_LUT, bmsdata->cell_temp[i]);
+			bmsdata->cell_resistance[i] = ((uint32_t)CELL_RES_LUT.y[res_index] * cell_res_get_scale(i)) >> CELL_RES_SCALE_Q;
+
+			/* Open cell voltage under load, see estimate_cell_ocv() */
+			int32_t ocv = estimate_cell_ocv(i);
+			if (ocv <= MAX_VOLT * 10000 && ocv >= MIN_VOLT * 10000)
+				bmsdata->cell_ocv[i] = ocv;
+			else if (is_first_reading_)
+				bmsdata->cell_ocv[i] = bmsdata->cell_voltage[i];
+			else
+				bmsdata->cell_ocv[i] = prevbmsdata->cell_ocv[i];
+
+			/* Pack extremes, first occurrence wins */
+			if (bmsdata->cell_voltage[i] > bmsdata->cell_voltage[max_volt])
+				max_volt = i;
+			if (bmsdata->cell_voltage[i] < bmsdata->cell_voltage[min_volt])
+				min_volt = i;
+			if (bmsdata->cell_ocv[i] > bmsdata->cell_ocv[max_ocv])
+				max_ocv = i;
+			if (bmsdata->cell_ocv[i] < bmsdata->cell_ocv[min_ocv])
+				min_ocv = i;
+			if (bmsdata->cell_temp[i] > bmsdata->cell_temp[max_temp])
+				max_temp = i;
+			if (bmsdata->cell_temp[i] < bmsdata->cell_temp[min_temp])
+				min_temp = i;
+
+			total_volt += bmsdata->cell_voltage[i];
+			total_ocv += bmsdata->cell_ocv[i];
+
+			/* Current limit candidates, see calc_min_cell_dcl() and calc_min_cell_ccl() */
+			uint32_t recip	= ((uint64_t)CELL_RES_RECIP[res_index] * cell_res_get_inv_scale(i)) >> CELL_RES_SCALE_Q;
+			uint16_t tmpDCL = cell_current_limit(bmsdata->cell_ocv[i] - DCL_VOLT_FLOOR, recip);
+			if (tmpDCL < limits.dcl)
+				limits.dcl = tmpDCL;
+
+			uint16_t tmpCCL = cell_current_limit(CCL_VOLT_CEILING - bmsdata->cell_ocv[i], recip);
+			if (tmpCCL < limits.ccl)
+				limits.ccl = tmpCCL;
 		}
-	} else {
-		start_timer(&ocvTimer, 1000);
+
+		/* calc_noise_volt_percent() only ends up counting the last cell of each chip */
+		noise_count[c / 2] += bmsdata->chip_data[c].noise_reading[NUM_CELLS_PER_CHIP - 1];
 	}
-	for (uint8_t chip = 0; chip < NUM_CHIPS; chip++) {
-		for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
-			/* Set OCV to the previous/existing OCV */
-			bmsdata->chip_data[chip].open_cell_voltage[cell]
-				= prevbmsdata->chip_data[chip].open_cell_voltage[cell];
-		}
+
+	set_crit_cellval(&bmsdata->max_voltage, bmsdata->cell_voltage[max_volt], max_volt);
+	set_crit_cellval(&bmsdata->min_voltage, bmsdata->cell_voltage[min_volt], min_volt);
+	set_crit_cellval(&bmsdata->max_ocv, bmsdata->cell_ocv[max_ocv], max_ocv);
+	set_crit_cellval(&bmsdata->min_ocv, bmsdata->cell_ocv[min_ocv], min_ocv);
+	set_crit_cellval(&bmsdata->max_temp, bmsdata->cell_temp[max_temp], max_temp);
+	set_crit_cellval(&bmsdata->min_temp, bmsdata->cell_temp[min_temp], min_temp);
+
+	bmsdata->avg_voltage  = total_volt / NUM_CELLS;
+	bmsdata->pack_voltage = total_volt / 1000; /* convert to voltage * 10 */
+	bmsdata->delt_voltage = bmsdata->max_voltage.val - bmsdata->min_voltage.val;
+
+	bmsdata->avg_ocv  = total_ocv / NUM_CELLS;
+	bmsdata->pack_ocv = total_ocv / 1000; /* convert to voltage * 10 */
+	bmsdata->delt_ocv = bmsdata->max_ocv.val - bmsdata->min_ocv.val;
+
+	for (uint8_t seg = 0; seg < NUM_SEGMENTS; seg++) {
+		bmsdata->segment_noise_percentage[seg]
+			= (uint8_t)(100 * (noise_count[seg]) / (NUM_CELLS_PER_CHIP * 2.0f));
 	}
+
+	return limits;
 }
 
+#ifdef ANALYZER_REFERENCE
+/**
+ * @brief Reruns the original per function analysis on a copy of the frame and reports anything
+ *      the fused passes got differently, along with how long each took
+ */
+void compare_reference()
+{
+	static acc_data_t reference;
+	acc_data_t* fused = bmsdata;
+
+	uint32_t start = DWT->CYCCNT;
+	analyze_therms();
+	analyze_cells();
+	uint32_t fused_cycles = DWT->CYCCNT - start;
+
+	memcpy(&reference, fused, sizeof(acc_data_t));
+	bmsdata = &reference;
+
+	start = DWT->CYCCNT;
+	disable_therms();
+	calc_cell_temps();
+	calc_pack_temps();
+	calc_cell_resistances();
+	calc_open_cell_voltage();
+	calc_pack_voltage_stats();
+	int16_t dcl = calc_min_cell_dcl();
+	int16_t ccl = calc_min_cell_ccl();
+	calc_noise_volt_percent();
+	uint32_t reference_cycles = DWT->CYCCNT - start;
+
+	bmsdata = fused;
+
+	cell_limits_t limits = analyze_cells();
+	if (memcmp(&reference, fused, sizeof(acc_data_t)) || limits.dcl != dcl || limits.ccl != ccl)
+		printf("Fused analysis mismatch\r\n");
+	printf("Analysis cycles, fused: %lu reference: %lu\r\n", fused_cycles, reference_cycles);
+}
+#endif
+
 uint8_t analyzer_calc_fan_pwm()
 {
-	/* Resistance LUT increments by 5C for each index, plus we account for negative minimum */
-	uint8_t min_res_index = (bmsdata->max_temp.val - MIN_TEMP) / 5;
-	/* Ints are roounded down, so this would be the value if rounded up */
-	uint8_t max_res_index = (bmsdata->max_temp.val - MIN_TEMP) / 5 + 1;
-	/* Determine how far into the 5C interval the temp is */
-	uint8_t part_of_index = (bmsdata->max_temp.val - MIN_TEMP) % 5;
+	/* The fan curve has always been driven at half of its PWM */
+	return lut_lookup(&FAN_LUT, bmsdata->max_temp.val) / 2;
+}
+
+acc_data_t* analyzer_acquire_frame()
+{
+	/* the slot after bmsdata is always the oldest one, and is never bmsdata or prevbmsdata */
+	acc_data_t* frame = &frame_pool[(pool_head + 1) % NUM_POOL_FRAMES];
+	memset(frame, 0, sizeof(acc_data_t));
 
-	/* Uses fan LUT and finds low and upper end. Then takes average, weighted to how far into the
-	 * interval the exact temp is */
-	return ((FAN_CURVE[max_res_index] * part_of_index)
-			+ (FAN_CURVE[min_res_index] * (5 - part_of_index)))
-		   / (2 * 5);
+	return frame;
 }
 
-void analyzer_push(acc_data_t* data)
+acc_data_t* analyzer_get_history(uint8_t age)
 {
-	if (prevbmsdata != NULL)
-		free(bmsdata);
+	if (age >= pool_pushed)
+		return NULL;
+
+	return &frame_pool[(pool_head + NUM_POOL_FRAMES - age) % NUM_POOL_FRAMES];
+}
 
+void analyzer_push(acc_data_t* data)
+{
 	prevbmsdata = bmsdata;
 	bmsdata		= data;
 
-	disable_therms();
+	pool_head = data - frame_pool;
+	/* one slot is always reserved for the frame being filled */
+	if (pool_pushed < NUM_POOL_FRAMES - 1)
+		pool_pushed++;
 
 	//high_curr_therm_check(); /* = prev if curr > 50 */
 	// diff_curr_therm_check();     /* = prev if curr - prevcurr > 10 */
@@ -579,23 +710,136 @@ void analyzer_push(acc_data_t* data)
 	// standard_dev_therm_check();  /* = prev if std dev > 3 */
 	// averaging_therm_check();     /* matt shitty incrementing */
 
-	calc_cell_temps();
-	calc_pack_temps();
-	calc_pack_voltage_stats();
-	calc_open_cell_voltage();
-	calc_cell_resistances();
-	calc_dcl();
-	calc_cont_dcl();
-	//calcCCL();
-	calc_cont_ccl();
+	uint8_t changed = changed_sources();
+
+	/*
+	 * One pass over the thermistors and one over the cells stand in for disable_therms(),
+	 * calc_cell_temps(), calc_pack_temps(), calc_open_cell_voltage(), calc_pack_voltage_stats(),
+	 * calc_cell_resistances(), the per cell part of calc_dcl() and calc_noise_volt_percent()
+	 */
+	bool recomputed = true;
+	for (uint8_t stage = 0; stage < NUM_ANALYSIS_STAGES; stage++) {
+		if (analysis_stages[stage].inputs & changed) {
+			analysis_stages[stage].run();
+			stage_stats[stage].executed++;
+		} else {
+			analysis_stages[stage].reuse();
+			stage_stats[stage].skipped++;
+			recomputed = false;
+		}
+	}
+
+#ifdef ANALYZER_REFERENCE
+	/* Disabled therms pull towards the last average, so only a full recompute matches the reference */
+	if (recomputed)
+		compare_reference();
+#else
+	(void)recomputed;
+#endif
+
+	/* Heat and charge build up with time whether or not any source has new data, so these always run */
+	calc_thermal_estimates();
+	calc_pack_limits();
 	calc_state_of_charge();
-	calc_noise_volt_percent();
 
-	data->charge_limit = data->cont_CCL;
+	/* The predictions only move with the filters, which only step on new voltages, and the temps */
+	if (changed & (FRAME_SRC_BIT(FRAME_SRC_VOLTAGE) | FRAME_SRC_BIT(FRAME_SRC_THERM)))
+		calc_current_limits();
+	apply_current_limits();
+
+	/* The OCV based limit stays as a check on the filters, and the DCL hold runs off of a timer */
+	uint16_t peak_dcl = data->dcl_horizon[LIMIT_PEAK];
+	apply_dcl(cell_limits.dcl < peak_dcl ? cell_limits.dcl : peak_dcl);
+	//apply_ccl(cell_limits.ccl);
+
+	uint16_t peak_ccl  = data->ccl_horizon[LIMIT_PEAK];
+	data->charge_limit = data->cont_CCL < peak_ccl ? data->cont_CCL : peak_ccl;
+
+	/* The OCV check can pull the published peak under the predictions, no longer hold gets more */
+	for (uint8_t h = 0; h < NUM_LIMIT_HORIZONS; h++) {
+		if (data->dcl_horizon[h] > data->discharge_limit)
+			data->dcl_horizon[h] = data->discharge_limit;
+		if (data->ccl_horizon[h] > data->charge_limit)
+			data->ccl_horizon[h] = data->charge_limit;
+	}
 
 	is_first_reading_ = false;
 }
 
+const analysis_stage_stats_t* analyzer_get_stage_stats(analysis_stage_id_t stage)
+{
+	return &stage_stats[stage];
+}
+
+uint8_t changed_sources()
+{
+	/* Nothing to carry over from yet */
+	if (is_first_reading_ || prevbmsdata == NULL)
+		return (1 << NUM_FRAME_SOURCES) - 1;
+
+	uint8_t changed = 0;
+	for (uint8_t src = 0; src < NUM_FRAME_SOURCES; src++) {
+		if (bmsdata->generation[src] != prevbmsdata->generation[src])
+			changed |= FRAME_SRC_BIT(src);
+	}
+
+	return changed;
+}
+
+void run_cell_stage()
+{
+	gather_cell_voltages();
+
+	/* New thermistor readings alone run this stage too, only new voltages move what's fitted to them */
+	if (new_cell_voltages()) {
+		estimate_cell_resistances();
+		latch_cell_rc_drops();
+	}
+	cell_limits = analyze_cells();
+}
+
+void calc_pack_limits()
+{
+	calc_cont_dcl();
+	calc_cont_ccl();
+}
+
+void reuse_therms()
+{
+	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+		memcpy(bmsdata->chip_data[c].thermistor_value, prevbmsdata->chip_data[c].thermistor_value,
+			sizeof(bmsdata->chip_data[c].thermistor_value));
+	}
+	memcpy(bmsdata->segment_average_temps, prevbmsdata->segment_average_temps,
+		sizeof(bmsdata->segment_average_temps));
+	bmsdata->avg_temp = prevbmsdata->avg_temp;
+}
+
+void reuse_cells()
+{
+	memcpy(bmsdata->cell_voltage, prevbmsdata->cell_voltage, sizeof(bmsdata->cell_voltage));
+	memcpy(bmsdata->cell_ocv, prevbmsdata->cell_ocv, sizeof(bmsdata->cell_ocv));
+	memcpy(bmsdata->cell_temp, prevbmsdata->cell_temp, sizeof(bmsdata->cell_temp));
+	memcpy(bmsdata->cell_resistance, prevbmsdata->cell_resistance, sizeof(bmsdata->cell_resistance));
+	memcpy(bmsdata->segment_noise_percentage, prevbmsdata->segment_noise_percentage,
+		sizeof(bmsdata->segment_noise_percentage));
+
+	bmsdata->max_voltage  = prevbmsdata->max_voltage;
+	bmsdata->min_voltage  = prevbmsdata->min_voltage;
+	bmsdata->avg_voltage  = prevbmsdata->avg_voltage;
+	bmsdata->pack_voltage = prevbmsdata->pack_voltage;
+	bmsdata->delt_voltage = prevbmsdata->delt_voltage;
+
+	bmsdata->max_ocv  = prevbmsdata->max_ocv;
+	bmsdata->min_ocv  = prevbmsdata->min_ocv;
+	bmsdata->avg_ocv  = prevbmsdata->avg_ocv;
+	bmsdata->pack_ocv = prevbmsdata->pack_ocv;
+	bmsdata->delt_ocv = prevbmsdata->delt_ocv;
+
+	bmsdata->max_temp = prevbmsdata->max_temp;
+	bmsdata->min_temp = prevbmsdata->min_temp;
+}
+
 void disable_therms()
 {
 	int8_t tmp_temp = 25; /* Iniitalize to room temp (necessary to stabilize when the BMS first boots up/has null values) */
@@ -615,28 +859,244 @@ void disable_therms()
 	}
 }
 
+bool new_cell_voltages()
+{
+	if (is_first_reading_ || prevbmsdata == NULL)
+		return true;
+
+	return bmsdata->generation[FRAME_SRC_VOLTAGE] != prevbmsdata->generation[FRAME_SRC_VOLTAGE];
+}
+
+void estimate_cell_resistances()
+{
+	if (is_first_reading_ || prevbmsdata == NULL)
+		cell_res_init();
+
+	/* Steps are only taken between two real sets of voltages, not from the zeroed ones before the first conversion */
+	if (prevbmsdata == NULL || prevbmsdata->generation[FRAME_SRC_VOLTAGE] == 0) {
+		cell_voltage_current = bmsdata->voltage_current;
+		return;
+	}
+
+	int16_t current_step = bmsdata->voltage_current - cell_voltage_current;
+	cell_voltage_current	 = bmsdata->voltage_current;
+
+	/* Without a real step the voltages only show noise, so the estimates hold where they are */
+	if (abs(current_step) < CELL_RES_MIN_STEP)
+		return;
+
+	/* prevbmsdata still holds the last set of voltages, reuse_cells() carries them over */
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		float table_r0 = lut_lookup(&CELL_RES_LUT, prevbmsdata->cell_temp[i]) / (1000.0f * (1 << CELL_RES_Q));
+		float step	   = (bmsdata->cell_voltage[i] - prevbmsdata->cell_voltage[i]) / 10000.0f;
+
+		cell_res_update(i, current_step, step, table_r0);
+	}
+}
+
+void latch_cell_rc_drops()
+{
+	/* Held until the next new voltages, so the OCVs only move with the data they are taken from */
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		cell_rc_drop[i] = cell_soc[i].v_rc * 10000.0f;
+	}
+}
+
 void calc_state_of_charge()
 {
-	/* Spltting the delta voltage into 18 increments */
-	const uint16_t increments
-		= ((uint16_t)(MAX_VOLT * 10000 - MIN_VOLT * 10000) / ((MAX_VOLT - MIN_VOLT) * 10));
+	uint32_t net_discharged = bmsdata->net_discharged;
+
+	if (!soc_seeded) {
+		/* Frames from before the first conversion finishes carry zeroed voltages, nothing to start from */
+		if (bmsdata->generation[FRAME_SRC_VOLTAGE] == 0) {
+			if (prevbmsdata != NULL) {
+				bmsdata->soc	   = prevbmsdata->soc;
+				bmsdata->soc_bound = prevbmsdata->soc_bound;
+				bmsdata->pack_ah   = prevbmsdata->pack_ah;
+			}
+			return;
+		}
 
-	/* Retrieving a index of 0-18 */
-	uint8_t index = ((bmsdata->min_ocv.val) - MIN_VOLT * 10000) / increments;
+		/* Start every filter from the OCV lookup */
+		for (uint8_t i = 0; i < NUM_CELLS; i++) {
+			soc_ekf_init(&cell_soc[i], lut_lookup(&SOC_LUT, bmsdata->cell_ocv[i]) / 100.0f);
+			cell_soc_discharged[i] = net_discharged;
+			cell_soc_time[i]	   = bmsdata->timestamp;
+		}
+		soc_voltage_generation = bmsdata->generation[FRAME_SRC_VOLTAGE];
+		soc_seeded			   = true;
+	} else if (bmsdata->generation[FRAME_SRC_VOLTAGE] != soc_voltage_generation) {
+		/* Only new voltages are worth correcting with, a repeated reading would be counted twice */
+		for (uint8_t n = 0; n < SOC_EKF_CELLS_PER_FRAME; n++) {
+			uint8_t i = next_soc_cell;
+			float r0  = bmsdata->cell_resistance[i] / (1000.0f * (1 << CELL_RES_Q));
+
+			soc_ekf_predict(&cell_soc[i], (int32_t)(net_discharged - cell_soc_discharged[i]) / 1000.0f,
+							(bmsdata->timestamp - cell_soc_time[i]) / 1000.0f, r0);
+			soc_ekf_correct(&cell_soc[i], bmsdata->cell_voltage[i] / 10000.0f, bmsdata->voltage_current, r0);
+
+			cell_soc_discharged[i] = net_discharged;
+			cell_soc_time[i]	   = bmsdata->timestamp;
+			next_soc_cell		   = (next_soc_cell + 1) % NUM_CELLS;
+		}
+		soc_voltage_generation = bmsdata->generation[FRAME_SRC_VOLTAGE];
+	}
 
-	bmsdata->soc = STATE_OF_CHARGE_CURVE[index];
+	/* The weakest cell sets the pack SOC, each counted forward from when its filter last ran */
+	uint8_t weakest	  = 0;
+	float weakest_soc = 1.0f;
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		float soc = cell_soc[i].soc
+					- (int32_t)(net_discharged - cell_soc_discharged[i]) * (1.0f / (PACK_CAPACITY * 3600000.0f));
+		if (i == 0 || soc < weakest_soc) {
+			weakest		= i;
+			weakest_soc = soc;
+		}
+	}
+	if (weakest_soc < 0.0f)
+		weakest_soc = 0.0f;
+	else if (weakest_soc > 1.0f)
+		weakest_soc = 1.0f;
 
-	if (bmsdata->soc != 100) {
-		float interpolation
-			= (float)(STATE_OF_CHARGE_CURVE[index + 1] - STATE_OF_CHARGE_CURVE[index]) / increments;
-		bmsdata->soc
-			+= (uint8_t)(interpolation
-						 * (((bmsdata->min_ocv.val) - (int32_t)(MIN_VOLT * 10000)) % increments));
+	float bound = soc_ekf_bound(&cell_soc[weakest]);
+
+	bmsdata->soc	   = weakest_soc * 100.0f + 0.5f;
+	bmsdata->soc_bound = (bound < 1.0f ? bound : 1.0f) * 100.0f + 0.5f;
+	bmsdata->pack_ah   = weakest_soc * PACK_CAPACITY * 10.0f;
+}
+
+void calc_current_limits()
+{
+	static const uint8_t horizon_time[NUM_LIMIT_HORIZONS]
+		= { [LIMIT_PEAK] = PEAK_LIMIT_TIME, [LIMIT_SHORT] = SHORT_LIMIT_TIME, [LIMIT_CONT] = CONT_LIMIT_TIME };
+
+	if (is_first_reading_) {
+		for (uint8_t h = 0; h < NUM_LIMIT_HORIZONS; h++) {
+			soc_ekf_horizon_init(&limit_horizons[h], horizon_time[h]);
+		}
 	}
 
-	if (bmsdata->soc < 0) {
-		bmsdata->soc = 0;
+	/* Filters that haven't seen a voltage yet predict nothing, the limits stay at 0 until they have */
+	if (!soc_seeded)
+		return;
+
+	float dcl[NUM_LIMIT_HORIZONS];
+	float ccl[NUM_LIMIT_HORIZONS];
+	for (uint8_t h = 0; h < NUM_LIMIT_HORIZONS; h++) {
+		dcl[h] = MAX_CELL_CURR;
+		ccl[h] = MAX_CHG_CELL_CURR;
 	}
+
+	/* Every cell carries the whole pack current, so the weakest one over each horizon sets it */
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		float r0 = bmsdata->cell_resistance[i] * (1.0f / (1000.0f * (1 << CELL_RES_Q)));
+		float discharge[NUM_LIMIT_HORIZONS];
+		float charge[NUM_LIMIT_HORIZONS];
+
+		soc_ekf_current_limits(&cell_soc[i], r0, limit_horizons, NUM_LIMIT_HORIZONS, DCL_VOLT_FLOOR / 10000.0f,
+							   CCL_VOLT_CEILING / 10000.0f, discharge, charge);
+
+		for (uint8_t h = 0; h < NUM_LIMIT_HORIZONS; h++) {
+			if (discharge[h] < dcl[h])
+				dcl[h] = discharge[h];
+			if (charge[h] < ccl[h])
+				ccl[h] = charge[h];
+		}
+	}
+
+	for (uint8_t h = 0; h < NUM_LIMIT_HORIZONS; h++) {
+		predicted_dcl[h] = dcl[h];
+		predicted_ccl[h] = ccl[h];
+	}
+}
+
+void apply_current_limits()
+{
+	memcpy(bmsdata->dcl_horizon, predicted_dcl, sizeof(bmsdata->dcl_horizon));
+	memcpy(bmsdata->ccl_horizon, predicted_ccl, sizeof(bmsdata->ccl_horizon));
+
+	/* Held for long enough, heat becomes the limit rather than voltage */
+	if (bmsdata->cont_DCL < bmsdata->dcl_horizon[LIMIT_CONT])
+		bmsdata->dcl_horizon[LIMIT_CONT] = bmsdata->cont_DCL;
+	if (bmsdata->cont_CCL < bmsdata->ccl_horizon[LIMIT_CONT])
+		bmsdata->ccl_horizon[LIMIT_CONT] = bmsdata->cont_CCL;
+}
+
+/**
+ * @brief Returns if the latest thermistor readings came off of every chip in the segment
+ */
+bool segment_therms_fresh(uint8_t seg)
+{
+	for (uint8_t c = seg * NUM_CHIPS_PER_SEGMENT; c < (seg + 1) * NUM_CHIPS_PER_SEGMENT; c++) {
+		if (bmsdata->chip_data[c].therm_stale_age != 0)
+			return false;
+	}
+
+	return true;
+}
+
+void calc_thermal_estimates()
+{
+	float dt			= (bmsdata->timestamp - thermal_time) / 1000.0f;
+	bool new_temps		= bmsdata->generation[FRAME_SRC_THERM] != thermal_therm_generation;
+	thermal_time		= bmsdata->timestamp;
+	thermal_therm_generation = bmsdata->generation[FRAME_SRC_THERM];
+
+	/* Every cell carries the whole pack current */
+	float current_sq = (float)bmsdata->pack_current * bmsdata->pack_current;
+
+	uint8_t hottest = 0, coldest = 0;
+	int32_t hottest_temp = 0, coldest_temp = 0;
+	for (uint8_t seg = 0; seg < NUM_SEGMENTS; seg++) {
+		uint8_t first			= seg * NUM_CELLS_PER_SEGMENT;
+		uint8_t seg_hot			= first, seg_cold = first;
+		int32_t temp_sum		= 0;
+		uint32_t resistance_sum = 0;
+		for (uint8_t i = first; i < first + NUM_CELLS_PER_SEGMENT; i++) {
+			temp_sum += bmsdata->cell_temp[i];
+			resistance_sum += bmsdata->cell_resistance[i];
+			if (bmsdata->cell_temp[i] > bmsdata->cell_temp[seg_hot])
+				seg_hot = i;
+			if (bmsdata->cell_temp[i] < bmsdata->cell_temp[seg_cold])
+				seg_cold = i;
+		}
+		float measured = temp_sum / (float)NUM_CELLS_PER_SEGMENT;
+
+		thermal_model_t* model = &segment_thermal[seg];
+		if (segment_therm_scans[seg] < THERM_SCAN_GENERATIONS) {
+			/* Held on the readings until they are all real, the zeros from before the scan would start it cold */
+			if (new_temps && segment_therms_fresh(seg))
+				segment_therm_scans[seg]++;
+			thermal_init(model, measured);
+		} else {
+			float heat = current_sq * resistance_sum / (1000.0f * (1 << CELL_RES_Q));
+			thermal_predict(model, heat, bmsdata->fan_duty[seg] / 100.0f, dt);
+
+			/* Only new readings are worth correcting with, a repeated one would be counted twice */
+			if (new_temps)
+				thermal_correct(model, measured);
+		}
+
+		/*
+		 * How far the model has the segment ahead of its thermistors. It only ever makes the
+		 * hottest cell hotter and the coldest colder, so the estimate can't hide a reading
+		 */
+		float ahead		 = model->temp - measured;
+		int32_t hot_temp  = bmsdata->cell_temp[seg_hot] + (ahead > 0.0f ? (int32_t)(ahead + 0.5f) : 0);
+		int32_t cold_temp = bmsdata->cell_temp[seg_cold] + (ahead < 0.0f ? (int32_t)(ahead - 0.5f) : 0);
+
+		if (seg == 0 || hot_temp > hottest_temp) {
+			hottest		 = seg_hot;
+			hottest_temp = hot_temp;
+		}
+		if (seg == 0 || cold_temp < coldest_temp) {
+			coldest		 = seg_cold;
+			coldest_temp = cold_temp;
+		}
+	}
+
+	set_crit_cellval(&bmsdata->est_max_temp, hottest_temp, hottest);
+	set_crit_cellval(&bmsdata->est_min_temp, coldest_temp, coldest);
 }
 
 void calc_noise_volt_percent()
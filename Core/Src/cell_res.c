@@ -0,0 +1,100 @@
+#include "cell_res.h"
+#include "datastructs.h"
+
+/*
+ * Over the few tens of ms between two cell voltage readings the OCV and the RC pair barely move,
+ * so when the pack current steps by dI the cell voltage steps by -R0 * dI. Each cell's R0 is
+ * estimated as a scale on the resistance table, which keeps the temperature dependence the table
+ * already has and leaves one parameter per cell, so the recursive least squares fit is scalar:
+ *
+ *     y = dV     x = -dI * R_table     y = scale * x + noise
+ *
+ * Older steps are forgotten geometrically, so the estimate follows the cells as they age.
+ */
+
+/* Estimator tuning, may need adjustment once fitted to logged drive data */
+#define RES_FORGET		 0.98f	/* weight each accepted step leaves the ones before it */
+#define RES_STEP_NOISE	 0.003f /* V, two voltage readings plus whatever relaxed in between */
+#define RES_OUTLIER		 3.0f	/* standard deviations a step may miss the prediction by */
+#define RES_MAX_OUTLIERS 5		/* outliers in a row before the estimate is started over */
+#define RES_INIT_NOISE	 0.5f	/* scale standard deviation before any steps */
+#define RES_TRUST_NOISE	 0.1f	/* the estimate replaces the table once its deviation is below this */
+
+/* Anything outside of this is a bad tap or a bad table, not the cell */
+#define RES_SCALE_MIN 0.5f
+#define RES_SCALE_MAX 4.0f
+
+typedef struct {
+	float scale;
+	float p; /* variance of scale */
+	uint8_t outliers;
+} res_estimate_t;
+
+static res_estimate_t estimates[NUM_CELLS];
+
+/* What the analysis reads, held at the table until the estimate is trusted */
+static uint16_t scales[NUM_CELLS];
+static uint16_t inv_scales[NUM_CELLS];
+
+static void restart(uint8_t cell)
+{
+	estimates[cell].scale	 = 1.0f;
+	estimates[cell].p		 = RES_INIT_NOISE * RES_INIT_NOISE;
+	estimates[cell].outliers = 0;
+
+	scales[cell]	 = 1 << CELL_RES_SCALE_Q;
+	inv_scales[cell] = 1 << CELL_RES_SCALE_Q;
+}
+
+void cell_res_init()
+{
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		restart(i);
+	}
+}
+
+void cell_res_update(uint8_t cell, float current_step, float voltage_step, float table_r0)
+{
+	res_estimate_t* est = &estimates[cell];
+
+	float x		   = -current_step * table_r0;
+	float residual = voltage_step - est->scale * x;
+	float variance = x * x * est->p + RES_STEP_NOISE * RES_STEP_NOISE;
+
+	/* A step this far off is a bad reading or a current edge the two samples straddled */
+	if (residual * residual > RES_OUTLIER * RES_OUTLIER * variance) {
+		/* Unless they keep coming, then it's the estimate that is off */
+		if (++est->outliers >= RES_MAX_OUTLIERS)
+			restart(cell);
+		return;
+	}
+	est->outliers = 0;
+
+	float gain = est->p * x / variance;
+	est->scale += gain * residual;
+	est->p = (1.0f - gain * x) * est->p / RES_FORGET;
+
+	if (est->scale < RES_SCALE_MIN)
+		est->scale = RES_SCALE_MIN;
+	else if (est->scale > RES_SCALE_MAX)
+		est->scale = RES_SCALE_MAX;
+
+	/* Forgetting can't be allowed to grow the variance past where it started */
+	if (est->p > RES_INIT_NOISE * RES_INIT_NOISE)
+		est->p = RES_INIT_NOISE * RES_INIT_NOISE;
+
+	if (est->p < RES_TRUST_NOISE * RES_TRUST_NOISE) {
+		scales[cell]	 = est->scale * (1 << CELL_RES_SCALE_Q) + 0.5f;
+		inv_scales[cell] = (1 << CELL_RES_SCALE_Q) / est->scale + 0.5f;
+	}
+}
+
+uint16_t cell_res_get_scale(uint8_t cell)
+{
+	return scales[cell];
+}
+
+uint16_t cell_res_get_inv_scale(uint8_t cell)
+{
+	return inv_scales[cell];
+}
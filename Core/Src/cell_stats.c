@@ -0,0 +1,155 @@
+#include "cell_stats.h"
+#include "main.h"
+
+/*
+ * The SIMD passes only track the extreme values. USUB16/SSUB8 set the GE flag of each lane
+ * where the new value is >= the running one and SEL then picks lane by lane, so there are no
+ * branches in the loop. The index of the first occurrence is found with a second, early exit
+ * scan afterwards.
+ */
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#define CELL_STATS_SIMD
+#endif
+
+#ifdef CELL_STATS_SIMD
+static uint8_t find_u16(const uint16_t* vals, uint8_t num, uint16_t val)
+{
+	uint8_t i = 0;
+	while (i < num - 1 && vals[i] != val)
+		i++;
+
+	return i;
+}
+
+static uint8_t find_s8(const int8_t* vals, uint8_t num, int8_t val)
+{
+	uint8_t i = 0;
+	while (i < num - 1 && vals[i] != val)
+		i++;
+
+	return i;
+}
+#endif
+
+void cell_stats_u16(const uint16_t* vals, uint8_t num, cell_stats_u16_t* stats)
+{
+#ifdef CELL_STATS_SIMD
+	uint32_t min = 0xFFFFFFFF;
+	uint32_t max = 0;
+	uint32_t sum = 0;
+	uint8_t i	 = 0;
+
+	for (; i + 2 <= num; i += 2) {
+		uint32_t pair = __UNALIGNED_UINT32_READ(&vals[i]);
+
+		__USUB16(pair, min);
+		min = __SEL(min, pair);
+		__USUB16(pair, max);
+		max = __SEL(pair, max);
+
+		sum += (pair & 0xFFFF) + (pair >> 16);
+	}
+
+	/* Fold the two lanes and pick up an odd one out */
+	uint16_t min_val = (min & 0xFFFF) < (min >> 16) ? (min & 0xFFFF) : (min >> 16);
+	uint16_t max_val = (max & 0xFFFF) > (max >> 16) ? (max & 0xFFFF) : (max >> 16);
+	if (i < num) {
+		if (vals[i] < min_val)
+			min_val = vals[i];
+		if (vals[i] > max_val)
+			max_val = vals[i];
+		sum += vals[i];
+	}
+
+	stats->min		 = min_val;
+	stats->max		 = max_val;
+	stats->min_index = find_u16(vals, num, min_val);
+	stats->max_index = find_u16(vals, num, max_val);
+	stats->sum		 = sum;
+#else
+	stats->min		 = vals[0];
+	stats->max		 = vals[0];
+	stats->min_index = 0;
+	stats->max_index = 0;
+	stats->sum		 = vals[0];
+
+	for (uint8_t i = 1; i < num; i++) {
+		if (vals[i] < stats->min) {
+			stats->min		 = vals[i];
+			stats->min_index = i;
+		}
+		if (vals[i] > stats->max) {
+			stats->max		 = vals[i];
+			stats->max_index = i;
+		}
+		stats->sum += vals[i];
+	}
+#endif
+}
+
+void cell_stats_s8(const int8_t* vals, uint8_t num, cell_stats_s8_t* stats)
+{
+#ifdef CELL_STATS_SIMD
+	uint32_t min  = 0x7F7F7F7F;
+	uint32_t max  = 0x80808080;
+	uint32_t sums = 0; /* bytes 0 and 1 sum into the low half, 2 and 3 into the high half */
+	uint8_t i	  = 0;
+
+	for (; i + 4 <= num; i += 4) {
+		uint32_t quad = __UNALIGNED_UINT32_READ(&vals[i]);
+
+		__SSUB8(quad, min);
+		min = __SEL(min, quad);
+		__SSUB8(quad, max);
+		max = __SEL(quad, max);
+
+		/* At most 128 values land in each 16-bit lane, so neither can overflow */
+		sums = __SXTAB16(sums, quad);
+		sums = __SXTAB16(sums, __ROR(quad, 8));
+	}
+
+	int8_t min_val = (int8_t)min;
+	int8_t max_val = (int8_t)max;
+	for (uint8_t lane = 1; lane < 4; lane++) {
+		int8_t lane_min = (int8_t)(min >> (8 * lane));
+		int8_t lane_max = (int8_t)(max >> (8 * lane));
+		if (lane_min < min_val)
+			min_val = lane_min;
+		if (lane_max > max_val)
+			max_val = lane_max;
+	}
+
+	int32_t sum = (int16_t)(sums & 0xFFFF) + (int16_t)(sums >> 16);
+	for (; i < num; i++) {
+		if (vals[i] < min_val)
+			min_val = vals[i];
+		if (vals[i] > max_val)
+			max_val = vals[i];
+		sum += vals[i];
+	}
+
+	stats->min		 = min_val;
+	stats->max		 = max_val;
+	stats->min_index = find_s8(vals, num, min_val);
+	stats->max_index = find_s8(vals, num, max_val);
+	stats->sum		 = sum;
+#else
+	stats->min		 = vals[0];
+	stats->max		 = vals[0];
+	stats->min_index = 0;
+	stats->max_index = 0;
+	stats->sum		 = vals[0];
+
+	for (uint8_t i = 1; i < num; i++) {
+		if (vals[i] < stats->min) {
+			stats->min		 = vals[i];
+			stats->min_index = i;
+		}
+		if (vals[i] > stats->max) {
+			stats->max		 = vals[i];
+			stats->max_index = i;
+		}
+		stats->sum += vals[i];
+	}
+#endif
+}
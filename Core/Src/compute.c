@@ -1,4 +1,5 @@
 #include "compute.h"
+#include "coulomb.h"
 #include "can_handler.h"
 #include "can.h"
 #include "c_utils.h"
@@ -11,8 +12,21 @@
 #define MAX_CAN1_STORAGE 10
 #define MAX_CAN2_STORAGE 10
 
-#define REF_CHANNEL 0
-#define VOUT_CHANNEL 1
+/*
+ * ADC1 and ADC2 run in dual regular simultaneous mode, both triggered by every TIM2 update
+ * (4 kHz). The first conversion of a scan samples the low range sensor on ADC1 at the same
+ * instant as the high range sensor on ADC2, the second samples the 5V ref on ADC1. Both ADCs
+ * must run the same number of conversions and may not sample the same pin at once, so ADC2
+ * repeats the high range sensor in the second slot and that reading goes unused.
+ *
+ * DMA2 Stream0 copies both results of each slot as one word (ADC1 in the low half) into
+ * current_samples in circular mode. Every scan is range selected and converted on its own, and
+ * the half and full transfer interrupts average CURRENT_SCANS / 2 scans (4 ms) of those into the
+ * latest current, so nothing ever waits on the ADC. Every scan's current is also counted by the
+ * coulomb counter.
+ */
+#define CURRENT_SCANS 32
+enum { CURRENT_SLOT_SENSORS, CURRENT_SLOT_REF, NUM_CURRENT_SLOTS };
 
 //#define CHARGING_ENABLED
 
@@ -24,6 +38,7 @@ extern CAN_HandleTypeDef hcan1;
 extern CAN_HandleTypeDef hcan2;
 
 extern TIM_HandleTypeDef htim1;
+extern TIM_HandleTypeDef htim2;
 extern TIM_HandleTypeDef htim8;
 
 extern ADC_HandleTypeDef hadc1;
@@ -33,12 +48,22 @@ TIM_OC_InitTypeDef pwm_config;
 ADC_ChannelConfTypeDef adc_config;
 
 const uint32_t fan_channels[6] = {TIM_CHANNEL_3, TIM_CHANNEL_1, TIM_CHANNEL_4, TIM_CHANNEL_3, TIM_CHANNEL_2, TIM_CHANNEL_1};
+uint8_t fan_duty[FANMAX] = {};
 
 can_t can1; // main can bus, used by most peripherals
 can_t can2; // p2p can bus with charger
 
 uint32_t adc_values[2] = {0};
 
+static uint32_t current_samples[CURRENT_SCANS * NUM_CURRENT_SLOTS];
+
+/* Latest averaged reading, written from the DMA interrupts */
+static volatile int16_t sampled_pack_current = 0;
+
+/* Bumped whenever the pack current reading moves, see frame_source_t */
+uint16_t current_generation = 0;
+int16_t last_pack_current = 0;
+
 /* private function defintions */
 float read_ref_voltage();
 float read_vout();
@@ -75,8 +100,17 @@ uint8_t compute_init()
 	// HAL_TIM_PWM_Start(&htim8, fan_channels[FAN5]);
 	// HAL_TIM_PWM_Start(&htim8, fan_channels[FAN6]);
 	bmsdata->is_charger_connected = false;
-	
-	HAL_ADC_Start(&hadc2);
+
+	/* Charge is integrated per scan, so it counts at whatever rate TIM2 triggers them */
+	uint32_t timer_clock = HAL_RCC_GetPCLK1Freq();
+	if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_HCLK_DIV1)
+		timer_clock *= 2;
+	coulomb_init(timer_clock / ((htim2.Init.Prescaler + 1) * (htim2.Init.Period + 1)));
+
+	/* ADC2 only needs enabling, ADC1 starts both on each trigger */
+	if (HAL_ADC_Start(&hadc2) != HAL_OK) return -1;
+	if (HAL_ADCEx_MultiModeStart_DMA(&hadc1, current_samples, CURRENT_SCANS * NUM_CURRENT_SLOTS) != HAL_OK) return -1;
+	if (HAL_TIM_Base_Start(&htim2) != HAL_OK) return -1;
 
 	return 0;
 
@@ -154,88 +188,119 @@ uint8_t compute_set_fan_speed(TIM_HandleTypeDef* pwmhandle, fan_select_t fan_sel
 
 	CCR_value = (pwmhandle->Instance->ARR * duty_cycle) / 100;
 	__HAL_TIM_SET_COMPARE(pwmhandle, channel, CCR_value); 
+	fan_duty[fan_select] = duty_cycle;
 	
 	return 0;
 }
 
+uint8_t compute_get_fan_speed(fan_select_t fan_select)
+{
+	if (fan_select >= FANMAX) return 0;
+
+	return fan_duty[fan_select];
+}
+
 void compute_set_fault(int fault_state)
 {
 	//TODO work with charger fw on this
 	HAL_GPIO_WritePin(GPIOA, Fault_Output_Pin, !fault_state);
+
+	/* A fault opens the shutdown circuit, and with it the contactors */
+	coulomb_set_open(!fault_state);
 	 //if (true) digitalWrite(CHARGE_SAFETY_RELAY, 1);
 }
 
-int16_t compute_get_pack_current()
+/**
+ * @brief Converts one coherent set of current sensor readings to mA, against the 5V ref read in
+ *      the same scan
+ */
+static int32_t convert_pack_current(uint16_t raw_low_current, uint16_t raw_high_current, uint16_t ref_5V)
 {
-	// static const float GAIN = 5.00; // mV/A
-	// static const float OFFSET = 0.0; // mV
-	// static const uint8_t num_samples = 10;
-	// static int16_t current_accumulator = 0.0; // A
+	static const int32_t CURRENT_LOWCHANNEL_MAX = 75; //Amps
+    static const int32_t CURRENT_ADC_FULL_SCALE = 50000; // 0.1mV
 
-	// /* starting equation : Vout = Vref + Voffset  + (Gain * Ip) */
-	// float ref_voltage = read_ref_voltage();
-	// float vout = read_vout();
+    static const int32_t CURRENT_LOWCHANNEL_OFFSET = 25000; // 0.1mV, Calibrated with current = 0A
+    static const int32_t CURRENT_HIGHCHANNEL_OFFSET = 25000; // 0.1mV, Calibrated with current = 0A
 
-	// ref_voltage *= 1000;// convert to mV
-	// vout *= 1000;
+    static const int32_t HIGHCHANNEL_GAIN = 40; // 0.1mV/A, Calibrated with  current = 5A, 10A, 20A
+    static const int32_t LOWCHANNEL_GAIN = 267; // 0.1mV/A
 
-	// int16_t current = (vout - ref_voltage - OFFSET) / (GAIN); // convert to V
+	if (ref_5V == 0)
+		return 0;
 
-	// /* Low Pass Filter of Current*/
-	// current = ((current_accumulator * (num_samples - 1)) + current) / num_samples;
-	// current_accumulator = current;
+	/* The sensors are ratiometric to the 5V rail and can't read above it */
+	if (raw_low_current > ref_5V)
+		raw_low_current = ref_5V;
+	if (raw_high_current > ref_5V)
+		raw_high_current = ref_5V;
 
-	// return current;
+	int32_t low_current_voltage = CURRENT_ADC_FULL_SCALE * raw_low_current / ref_5V;
+	int32_t low_current = 1000 * (low_current_voltage - CURRENT_LOWCHANNEL_OFFSET) / LOWCHANNEL_GAIN;
 
-	static const float CURRENT_LOWCHANNEL_MAX = 75.0; //Amps
-    static const float CURRENT_LOWCHANNEL_MIN = -75.0; //Amps
-    // static const float CURRENT_SUPPLY_VOLTAGE = 5.038;
-    static const float CURRENT_ADC_RESOLUTION = 5.0 / MAX_ADC_RESOLUTION;
-
-    static const float CURRENT_LOWCHANNEL_OFFSET = 2.500; // Calibrated with current = 0A
-    static const float CURRENT_HIGHCHANNEL_OFFSET = 2.500; // Calibrated with current = 0A
+    // If the current is scoped within the range of the low channel, use the low channel
+	if (low_current > -1000 * (CURRENT_LOWCHANNEL_MAX - 5) && low_current < 1000 * (CURRENT_LOWCHANNEL_MAX - 5))
+		return -low_current;
 
-    static const float HIGHCHANNEL_GAIN = 1 / 0.0041; // Calibrated with  current = 5A, 10A, 20A
-    static const float LOWCHANNEL_GAIN = 1 / 0.0267;
+	int32_t high_current_voltage = CURRENT_ADC_FULL_SCALE * raw_high_current / ref_5V;
+	return -1000 * (high_current_voltage - CURRENT_HIGHCHANNEL_OFFSET) / HIGHCHANNEL_GAIN;
+}
 
-	// Change ADC channel to read the high current sensor
-	change_adc1_channel(VOUT_CHANNEL);
-	HAL_ADC_Start(&hadc1);
-	HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-	int raw_low_current = HAL_ADC_GetValue(&hadc1);
+/**
+ * @brief Averages CURRENT_SCANS / 2 scans starting at samples into the latest pack current and
+ *      counts their charge
+ */
+static void average_current_samples(const uint32_t* samples)
+{
+	int32_t sum = 0; /* mA */
 
-	HAL_ADC_Start(&hadc2);
-	HAL_ADC_PollForConversion(&hadc2, HAL_MAX_DELAY);
-	int raw_high_current = HAL_ADC_GetValue(&hadc2);
+	for (uint8_t scan = 0; scan < CURRENT_SCANS / 2; scan++) {
+		uint32_t sensors = samples[scan * NUM_CURRENT_SLOTS + CURRENT_SLOT_SENSORS];
+		uint32_t ref	 = samples[scan * NUM_CURRENT_SLOTS + CURRENT_SLOT_REF];
 
-	change_adc1_channel(REF_CHANNEL);
-	HAL_ADC_Start(&hadc1);
-	HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-	int ref_5V = HAL_ADC_GetValue(&hadc1);
-	
-	int16_t ref_voltage_raw = (int16_t)(1000.0f * ((float)ref_5V * CURRENT_ADC_RESOLUTION));
+		int32_t current = convert_pack_current(sensors & 0xFFFF, sensors >> 16, ref & 0xFFFF);
+		coulomb_add_sample(current);
+		sum += current;
+	}
 
-	int16_t high_current_voltage_raw = (int16_t)(1000.0f * ((float)raw_high_current * CURRENT_ADC_RESOLUTION));
-	high_current_voltage_raw = (int16_t)(5000.0f * high_current_voltage_raw / (float) ref_voltage_raw) ;
+	sampled_pack_current = sum / (1000 * (CURRENT_SCANS / 2));
+}
 
-	int16_t high_current = (high_current_voltage_raw - (1000 * CURRENT_HIGHCHANNEL_OFFSET)) * (1/4.0f); //* (HIGHCHANNEL_GAIN/100.0f))/1000;
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc)
+{
+	if (hadc->Instance == ADC1)
+		average_current_samples(&current_samples[0]);
+}
 
-	int16_t low_current_voltage_raw = (int16_t)(1000.0f * ((float)raw_low_current * CURRENT_ADC_RESOLUTION));
-	low_current_voltage_raw = (int16_t)(5000.0f * low_current_voltage_raw / (float) ref_voltage_raw) ;
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc)
+{
+	if (hadc->Instance == ADC1)
+		average_current_samples(&current_samples[CURRENT_SCANS / 2 * NUM_CURRENT_SLOTS]);
+}
 
-	int16_t low_current = (float)(low_current_voltage_raw - (1000 * CURRENT_LOWCHANNEL_OFFSET)) * (1/26.7); //* (LOWCHANNEL_GAIN/100.0f))/1000;
+void HAL_ADC_ErrorCallback(ADC_HandleTypeDef* hadc)
+{
+	/* An overrun stops the DMA requests, so restart the scan rather than go stale */
+	if (hadc->Instance == ADC1) {
+		HAL_ADCEx_MultiModeStop_DMA(hadc);
+		HAL_ADCEx_MultiModeStart_DMA(hadc, current_samples, CURRENT_SCANS * NUM_CURRENT_SLOTS);
+	}
+}
 
-    // If the current is scoped within the range of the low channel, use the low channel
+int16_t compute_get_pack_current()
+{
+	int16_t current = sampled_pack_current;
 
+	if (current != last_pack_current) {
+		last_pack_current = current;
+		current_generation++;
+	}
 
-    if((low_current < CURRENT_LOWCHANNEL_MAX - 5.0 && low_current >= 0) || (low_current > CURRENT_LOWCHANNEL_MIN + 5.0 && low_current < 0))
-    {
-		//printf("\rLow Current: %d\n", -low_current);
-        return -low_current;
-    }
+    return current;
+}
 
-	//printf("\rHigh Current: %d\n", -high_current);
-    return -high_current;
+uint16_t compute_get_current_generation()
+{
+	return current_generation;
 }
 
 void compute_send_mc_discharge_message(acc_data_t* bmsdata)
@@ -243,13 +308,19 @@ void compute_send_mc_discharge_message(acc_data_t* bmsdata)
 
 	struct __attribute__((__packed__)){
 		uint16_t max_discharge;
+		uint16_t short_discharge; /* can be held for SHORT_LIMIT_TIME */
+		uint16_t cont_discharge;  /* can be held for CONT_LIMIT_TIME */
 	} discharge_data;
 
 	/* scale to A * 10 */
 	discharge_data.max_discharge = 10 * bmsdata->discharge_limit;
+	discharge_data.short_discharge = 10 * bmsdata->dcl_horizon[LIMIT_SHORT];
+	discharge_data.cont_discharge = 10 * bmsdata->dcl_horizon[LIMIT_CONT];
 
 	/* convert to big endian */
 	endian_swap(&discharge_data.max_discharge, sizeof(discharge_data.max_discharge));
+	endian_swap(&discharge_data.short_discharge, sizeof(discharge_data.short_discharge));
+	endian_swap(&discharge_data.cont_discharge, sizeof(discharge_data.cont_discharge));
 
 
 	can_msg_t mc_msg = {0};
@@ -265,13 +336,19 @@ void compute_send_mc_charge_message(acc_data_t* bmsdata)
 
 	struct __attribute__((__packed__)){
 		int16_t max_charge;
+		int16_t short_charge; /* can be held for SHORT_LIMIT_TIME */
+		int16_t cont_charge;  /* can be held for CONT_LIMIT_TIME */
 	} charge_data;
 
 	/* scale to A * 10 */
 	charge_data.max_charge = -10 * bmsdata->charge_limit;
+	charge_data.short_charge = -10 * bmsdata->ccl_horizon[LIMIT_SHORT];
+	charge_data.cont_charge = -10 * bmsdata->ccl_horizon[LIMIT_CONT];
 
 	/* convert to big endian */
 	endian_swap(&charge_data.max_charge, sizeof(charge_data.max_charge));
+	endian_swap(&charge_data.short_charge, sizeof(charge_data.short_charge));
+	endian_swap(&charge_data.cont_charge, sizeof(charge_data.cont_charge));
 
 	can_msg_t mc_msg = {0};
 	mc_msg.id = 0x176;  // 0x0A is the dcl id, 0x157 is the device id set by us
@@ -294,7 +371,7 @@ void compute_send_acc_status_message(acc_data_t* bmsdata)
 
 	acc_status_msg_data.packVolt	    = bmsdata->pack_voltage;
 	acc_status_msg_data.pack_current = (uint16_t) (bmsdata->pack_current); // convert with 2s complement
-	acc_status_msg_data.pack_ah	    = 0;
+	acc_status_msg_data.pack_ah	    = bmsdata->pack_ah;
 	acc_status_msg_data.pack_soc	    = bmsdata->soc;
 	acc_status_msg_data.pack_health  = 0;
 
@@ -600,19 +677,42 @@ void compute_send_voltage_noise_message(acc_data_t* bmsdata)
 	#endif
 
 	can_send_msg(line, &acc_msg);
-}	
-void change_adc1_channel(uint8_t channel)
+}
+
+void compute_send_link_stats_message(uint8_t chip, const link_stats_t* stats)
 {
+	struct __attribute__((__packed__)){
+		uint8_t chip;
+		uint16_t pec_errors;
+		uint16_t retries;
+		uint8_t consecutive_failures;
+		uint8_t substituted_cells;
+		uint8_t last_good_age; /* 100ms units, saturates at 25.5s */
+	} link_stats_msg_data;
+
+	uint32_t last_good_age = (HAL_GetTick() - stats->last_good) / 100;
+
+	link_stats_msg_data.chip = chip;
+	link_stats_msg_data.pec_errors = stats->pec_errors;
+	link_stats_msg_data.retries = stats->retries;
+	link_stats_msg_data.consecutive_failures = stats->consecutive_failures;
+	link_stats_msg_data.substituted_cells = stats->substituted_cells > UINT8_MAX ? UINT8_MAX : stats->substituted_cells;
+	link_stats_msg_data.last_good_age = last_good_age > UINT8_MAX ? UINT8_MAX : last_good_age;
 
-  ADC_ChannelConfTypeDef sConfig = {0};
-
-  if (channel == REF_CHANNEL) sConfig.Channel = ADC_CHANNEL_9;
-  else if (channel == VOUT_CHANNEL) sConfig.Channel = ADC_CHANNEL_15;
-  
-  sConfig.Rank = 1;
-  sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-  {
-    Error_Handler();
-  }
+	/* convert to big endian */
+	endian_swap(&link_stats_msg_data.pec_errors, sizeof(link_stats_msg_data.pec_errors));
+	endian_swap(&link_stats_msg_data.retries, sizeof(link_stats_msg_data.retries));
+
+	can_msg_t acc_msg;
+	acc_msg.id = 0x89;
+	acc_msg.len = sizeof(link_stats_msg_data);
+	memcpy(acc_msg.data, &link_stats_msg_data, sizeof(link_stats_msg_data));
+
+	#ifdef CHARGING_ENABLED
+	can_t* line = &can2;
+	#else
+	can_t* line = &can1;
+	#endif
+
+	can_send_msg(line, &acc_msg);
 }
@@ -0,0 +1,203 @@
+#include "coulomb.h"
+#include "eepromdirectory.h"
+#include "main.h"
+#include "timer.h"
+
+#define COULOMB_SAVE_INTERVAL 60000		 /* ms */
+#define COULOMB_SAVE_DELTA	  100		 /* mAh either count has to move by before it's worth a write */
+#define COULOMB_RECORD_MAGIC  0x434F554C /* "COUL" */
+
+/*
+ * The sensor's zero offset is learned from windows where the pack is at rest: the contactors are
+ * known to be open, or the current holds within the sensor noise near zero for long enough that
+ * it can't be a load. Each one moves the offset part of the way to the window's mean. With the
+ * contactors closed a steady small load looks just like offset, so those windows are only trusted
+ * to follow drift close to the offset already learned
+ */
+#define COULOMB_OPEN_WINDOW	   2	/* s of samples averaged per window with the contactors open */
+#define COULOMB_SETTLED_WINDOW 30	/* s the current has to hold still to count as rest otherwise */
+#define COULOMB_REST_SPREAD	   250	/* mA, widest a window can read and still be sensor noise */
+#define COULOMB_MAX_OFFSET	   1000 /* mA, the sensor's worst zero offset, past this it's a load */
+#define COULOMB_MAX_DRIFT	   50	/* mA a settled window may sit from the offset and still be rest */
+#define COULOMB_OFFSET_WEIGHT  4	/* windows the offset moves 1 / this of the way towards */
+
+/*
+ * Charge is counted in mA samples, each worth 1 / sample_rate mAs, so adding a sample is exact
+ * and nothing is lost to rounding no matter how long the counter runs. Written from the sampling
+ * interrupt only
+ */
+static volatile uint64_t discharged = 0;
+static volatile uint64_t charged	= 0;
+static uint32_t samples_per_sec		= 0;
+
+/* Zero offset taken out of every sample, and the rest window it is being learned from */
+static volatile int32_t offset = 0; /* mA */
+static volatile bool pack_open	= false;
+static int64_t window_sum		= 0;
+static int32_t window_min		= 0;
+static int32_t window_max		= 0;
+static uint32_t window_samples	= 0;
+
+/* mAh counts as of the last save */
+static uint32_t saved_discharged = 0;
+static uint32_t saved_charged	 = 0;
+
+static uint32_t record_check(const coulomb_record_t* record)
+{
+	return record->magic ^ (uint32_t)record->discharged ^ (uint32_t)(record->discharged >> 32)
+		   ^ (uint32_t)record->charged ^ (uint32_t)(record->charged >> 32);
+}
+
+/**
+ * @brief Reads a count the sampling interrupt could update between the two halves of the read
+ */
+static uint64_t read_count(volatile uint64_t* count)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint64_t value = *count;
+	__set_PRIMASK(primask);
+
+	return value;
+}
+
+void coulomb_init(uint32_t sample_rate)
+{
+	samples_per_sec = sample_rate;
+
+	coulomb_record_t record;
+	if (!eeprom_read_data_key((char*)("COULOMBS"), &record, sizeof(record)))
+		return;
+
+	/* A blank or half written record starts the count over */
+	if (record.magic != COULOMB_RECORD_MAGIC || record.check != record_check(&record))
+		return;
+
+	discharged		 = record.discharged * samples_per_sec;
+	charged			 = record.charged * samples_per_sec;
+	saved_discharged = coulomb_get_discharged();
+	saved_charged	 = coulomb_get_charged();
+}
+
+/**
+ * @brief Adds a raw sample to the rest window, learning the offset from the window once it's full
+ */
+static void track_rest(int32_t current)
+{
+	if (window_samples == 0 || current < window_min)
+		window_min = current;
+	if (window_samples == 0 || current > window_max)
+		window_max = current;
+	window_sum += current;
+	window_samples++;
+
+	/* Anything moving more than the noise is a load, start the window over from here */
+	if (window_max - window_min > COULOMB_REST_SPREAD) {
+		window_sum	   = current;
+		window_min	   = current;
+		window_max	   = current;
+		window_samples = 1;
+		return;
+	}
+
+	uint32_t window = (pack_open ? COULOMB_OPEN_WINDOW : COULOMB_SETTLED_WINDOW) * samples_per_sec;
+	if (window_samples < window)
+		return;
+
+	/* A sensor reading this far out with nothing connected is broken, not offset */
+	int32_t mean  = window_sum / (int32_t)window_samples;
+	int32_t error = mean - offset;
+	int32_t limit = pack_open ? COULOMB_MAX_OFFSET : COULOMB_MAX_DRIFT;
+	if (mean > -COULOMB_MAX_OFFSET && mean < COULOMB_MAX_OFFSET && error > -limit && error < limit) {
+		offset += (error + (error < 0 ? -COULOMB_OFFSET_WEIGHT : COULOMB_OFFSET_WEIGHT) / 2)
+				  / COULOMB_OFFSET_WEIGHT;
+	}
+
+	window_samples = 0;
+	window_sum	   = 0;
+}
+
+void coulomb_add_sample(int32_t current)
+{
+	track_rest(current);
+
+	current -= offset;
+	if (current > 0)
+		discharged += current;
+	else
+		charged += -current;
+}
+
+void coulomb_set_open(bool is_open)
+{
+	/* Samples from before the change can't be trusted either way */
+	if (is_open != pack_open) {
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		pack_open	   = is_open;
+		window_samples = 0;
+		window_sum	   = 0;
+		__set_PRIMASK(primask);
+	}
+}
+
+int32_t coulomb_get_offset()
+{
+	return offset;
+}
+
+uint32_t coulomb_get_discharged()
+{
+	if (samples_per_sec == 0)
+		return 0;
+
+	return read_count(&discharged) / (3600ULL * samples_per_sec);
+}
+
+uint32_t coulomb_get_charged()
+{
+	if (samples_per_sec == 0)
+		return 0;
+
+	return read_count(&charged) / (3600ULL * samples_per_sec);
+}
+
+uint32_t coulomb_get_net_mas()
+{
+	if (samples_per_sec == 0)
+		return 0;
+
+	/* Both counts from the same instant, so a sample can't land in one and not the other */
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	int64_t net = discharged - charged;
+	__set_PRIMASK(primask);
+
+	return (uint32_t)(net / samples_per_sec);
+}
+
+void coulomb_save()
+{
+	static nertimer_t save_timer;
+
+	if (samples_per_sec == 0 || (is_timer_active(&save_timer) && !is_timer_expired(&save_timer)))
+		return;
+
+	uint32_t discharged_mah = coulomb_get_discharged();
+	uint32_t charged_mah	= coulomb_get_charged();
+	if (discharged_mah - saved_discharged < COULOMB_SAVE_DELTA
+		&& charged_mah - saved_charged < COULOMB_SAVE_DELTA)
+		return;
+
+	coulomb_record_t record;
+	record.magic	  = COULOMB_RECORD_MAGIC;
+	record.discharged = read_count(&discharged) / samples_per_sec;
+	record.charged	  = read_count(&charged) / samples_per_sec;
+	record.check	  = record_check(&record);
+
+	eeprom_write_data_key((char*)("COULOMBS"), &record, sizeof(record));
+
+	saved_discharged = discharged_mah;
+	saved_charged	 = charged_mah;
+	start_timer(&save_timer, COULOMB_SAVE_INTERVAL);
+}
@@ -1,5 +1,10 @@
 #include "eepromdirectory.h"
+#include "coulomb.h"
 #include "m24c32.h"
+#include <string.h>
+
+uint32_t eeprom_faults[NUM_EEPROM_FAULTS];
+struct eeprom_partition eeprom_data[NUM_EEPROM_ITEMS];
 
 void eepromInit()
 {   
@@ -9,6 +14,9 @@ void eepromInit()
     eeprom_data[1].id = (char*)("FAULTS");
     eeprom_data[1].size = 21;                      
 
+    eeprom_data[2].id = (char*)("COULOMBS");
+    eeprom_data[2].size = sizeof(coulomb_record_t);
+
     // Initialize EEPROM addresses given data and length
 
     int i = 1;
@@ -18,7 +26,7 @@ void eepromInit()
     eeprom_data[0].address = EEPROM_ROOT_ADDR;
 
     /* continue through array, setting offsets *//* private funciton prototypes */
-    while (eeprom_data[i].id != NULL)
+    while (i < NUM_EEPROM_ITEMS && eeprom_data[i].id != NULL)
     {
         offset += eeprom_data[i-1].size;
         eeprom_data[i].address = offset;
@@ -36,9 +44,9 @@ uint16_t eeprom_get_index(char *key)
 {
     /* find the index of the key in the eeprom_data array */
     int i = 0;
-    while (eeprom_data[i].id != NULL)
+    while (i < NUM_EEPROM_ITEMS && eeprom_data[i].id != NULL)
     {
-        if (eeprom_data[i].id == key)
+        if (strcmp(eeprom_data[i].id, key) == 0)
         {
             return eeprom_data[i].address;
         }
@@ -52,7 +60,7 @@ char* eeprom_get_key(int index)
 {
     /* find the key at the index in the eeprom_data array */
     int i = 0;
-    while (eeprom_data[i].id != NULL)
+    while (i < NUM_EEPROM_ITEMS && eeprom_data[i].id != NULL)
     {
         if (eeprom_data[i].address == index)
         {
@@ -0,0 +1,225 @@
+#include "ltc_dma.h"
+#include "pec15.h"
+#include <string.h>
+
+#define LTC_DMA_TIMEOUT 10 /* ms, longest a frame should ever take on the bus */
+
+/*
+ * ms, for the short polled transfers. They take a few us, but HAL times out once the tick has
+ * moved Timeout times, so with 1 a SysTick landing mid transfer fails it
+ */
+#define LTC_DMA_POLL_TIMEOUT 2
+
+/* Buses that have a transfer in flight get looked up here from the HAL callbacks */
+static ltc_dma_t* buses[LTC_DMA_MAX_BUSES];
+static uint8_t num_buses = 0;
+
+static inline uint32_t get_cycles() { return DWT->CYCCNT; }
+
+static inline void cs_write(ltc_dma_t* bus, GPIO_PinState state)
+{
+	HAL_GPIO_WritePin(bus->cs_port, bus->cs_pin, state);
+}
+
+static inline uint16_t xfer_len(ltc_dma_t* bus)
+{
+	return LTC_DMA_CMD_LEN + bus->num_chips * LTC_DMA_BYTES_PER_IC;
+}
+
+static HAL_StatusTypeDef wakeup(ltc_dma_t* bus)
+{
+	/* isoSPI drops to idle after a few ms without traffic, a dummy byte wakes the chain back up */
+	uint8_t dummy = 0xFF;
+
+	cs_write(bus, GPIO_PIN_RESET);
+	HAL_StatusTypeDef res = HAL_SPI_Transmit(bus->hspi, &dummy, 1, LTC_DMA_POLL_TIMEOUT);
+	cs_write(bus, GPIO_PIN_SET);
+
+	return res;
+}
+
+static HAL_StatusTypeDef start_transfer(ltc_dma_t* bus)
+{
+	uint16_t cmd = bus->cmds[bus->cmd_index];
+
+	bus->tx[0] = (uint8_t)(cmd >> 8);
+	bus->tx[1] = (uint8_t)(cmd);
+
+	uint16_t pec = pec15_compute(2, bus->tx);
+	bus->tx[2]	 = (uint8_t)(pec >> 8);
+	bus->tx[3]	 = (uint8_t)(pec);
+
+	cs_write(bus, GPIO_PIN_RESET);
+	HAL_StatusTypeDef res = HAL_SPI_TransmitReceive_DMA(
+		bus->hspi, bus->tx, bus->frames[bus->fill].rx[bus->cmd_index], xfer_len(bus));
+
+	if (res != HAL_OK)
+		cs_write(bus, GPIO_PIN_SET);
+
+	return res;
+}
+
+static void transfer_complete(ltc_dma_t* bus)
+{
+	uint32_t entry		   = get_cycles();
+	ltc_dma_frame_t* frame = &bus->frames[bus->fill];
+
+	cs_write(bus, GPIO_PIN_SET);
+
+	/* Chain the next command of the sequence */
+	if (++bus->cmd_index < frame->num_cmds) {
+		if (start_transfer(bus) != HAL_OK) {
+			bus->stats.errors++;
+			bus->busy = false;
+		}
+		bus->cpu_cycles += get_cycles() - entry;
+		return;
+	}
+
+	bus->stats.frames++;
+	bus->stats.bytes	  = frame->num_cmds * xfer_len(bus);
+	bus->stats.bus_cycles = get_cycles() - bus->start_cycle;
+	frame->sequence		  = bus->stats.frames;
+
+	/* Hand the completed frame over and let the next transfer fill the other one */
+	bus->fill ^= 1;
+	bus->frame_ready = true;
+	bus->busy		 = false;
+
+	if (bus->callback)
+		bus->callback(frame, bus->ctx);
+
+	bus->cpu_cycles += get_cycles() - entry;
+	bus->stats.cpu_cycles = bus->cpu_cycles;
+}
+
+static ltc_dma_t* find_bus(SPI_HandleTypeDef* hspi)
+{
+	for (uint8_t i = 0; i < num_buses; i++) {
+		if (buses[i]->hspi == hspi)
+			return buses[i];
+	}
+
+	return NULL;
+}
+
+void ltc_dma_init(ltc_dma_t* bus, SPI_HandleTypeDef* hspi, GPIO_TypeDef* cs_port, uint16_t cs_pin,
+				  uint8_t num_chips)
+{
+	memset(bus, 0, sizeof(ltc_dma_t));
+	bus->hspi	   = hspi;
+	bus->cs_port   = cs_port;
+	bus->cs_pin	   = cs_pin;
+	bus->num_chips = num_chips;
+
+	/* Everything after the command is don't care, the chips shift their registers out while we send 0xFF */
+	memset(bus->tx, 0xFF, sizeof(bus->tx));
+
+	if (num_buses < LTC_DMA_MAX_BUSES)
+		buses[num_buses++] = bus;
+
+	/* Cycle counter is used to time each frame */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void ltc_dma_set_callback(ltc_dma_t* bus, ltc_dma_callback_t callback, void* ctx)
+{
+	bus->callback = callback;
+	bus->ctx	  = ctx;
+}
+
+int ltc_dma_read(ltc_dma_t* bus, const uint16_t* cmds, uint8_t num_cmds)
+{
+	if (bus->busy || num_cmds == 0 || num_cmds > LTC_DMA_MAX_CMDS)
+		return -1;
+
+	uint32_t entry = get_cycles();
+
+	memcpy(bus->cmds, cmds, num_cmds * sizeof(uint16_t));
+	bus->frames[bus->fill].num_cmds = num_cmds;
+	bus->cmd_index					= 0;
+	bus->start_cycle				= entry;
+	bus->cpu_cycles					= 0;
+
+	/* A command clocked into a chain that is still asleep is lost */
+	if (wakeup(bus) != HAL_OK) {
+		bus->stats.errors++;
+		return -1;
+	}
+
+	bus->busy = true;
+	if (start_transfer(bus) != HAL_OK) {
+		bus->busy = false;
+		bus->stats.errors++;
+		return -1;
+	}
+
+	bus->cpu_cycles += get_cycles() - entry;
+	return 0;
+}
+
+int ltc_dma_send_command(ltc_dma_t* bus, uint16_t cmd)
+{
+	uint8_t tx[LTC_DMA_CMD_LEN] = { (uint8_t)(cmd >> 8), (uint8_t)(cmd) };
+
+	uint16_t pec = pec15_compute(2, tx);
+	tx[2]		 = (uint8_t)(pec >> 8);
+	tx[3]		 = (uint8_t)(pec);
+
+	ltc_dma_wait(bus);
+	if (wakeup(bus) != HAL_OK)
+		return -1;
+
+	cs_write(bus, GPIO_PIN_RESET);
+	HAL_StatusTypeDef res = HAL_SPI_Transmit(bus->hspi, tx, LTC_DMA_CMD_LEN, LTC_DMA_POLL_TIMEOUT);
+	cs_write(bus, GPIO_PIN_SET);
+
+	return res == HAL_OK ? 0 : -1;
+}
+
+bool ltc_dma_busy(ltc_dma_t* bus) { return bus->busy; }
+
+void ltc_dma_wait(ltc_dma_t* bus)
+{
+	uint32_t start = HAL_GetTick();
+
+	while (bus->busy) {
+		if (HAL_GetTick() - start > LTC_DMA_TIMEOUT) {
+			HAL_SPI_Abort(bus->hspi);
+			cs_write(bus, GPIO_PIN_SET);
+			bus->stats.errors++;
+			bus->busy = false;
+		}
+	}
+}
+
+const ltc_dma_frame_t* ltc_dma_get_frame(ltc_dma_t* bus)
+{
+	if (!bus->frame_ready)
+		return NULL;
+
+	bus->frame_ready = false;
+	return &bus->frames[bus->fill ^ 1];
+}
+
+const ltc_dma_stats_t* ltc_dma_get_stats(ltc_dma_t* bus) { return &bus->stats; }
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef* hspi)
+{
+	ltc_dma_t* bus = find_bus(hspi);
+
+	if (bus && bus->busy)
+		transfer_complete(bus);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi)
+{
+	ltc_dma_t* bus = find_bus(hspi);
+
+	if (bus && bus->busy) {
+		cs_write(bus, GPIO_PIN_SET);
+		bus->stats.errors++;
+		bus->busy = false;
+	}
+}
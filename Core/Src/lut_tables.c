@@ -0,0 +1,238 @@
+/* Generated by scripts/gen_luts.py from the curves in it, do not edit */
+
+#include "lut_tables.h"
+
+static const int16_t CELL_RES_LUT_Y[91] = {
+	1413, 1379, 1344, 1309, 1274, 1239, 1210, 1181, 1152, 1123, 1093, 1063,
+	1033, 1003, 973, 942, 916, 889, 863, 836, 809, 788, 766, 745,
+	723, 701, 684, 667, 649, 632, 614, 600, 586, 572, 558, 543,
+	536, 529, 522, 515, 507, 504, 501, 498, 495, 492, 491, 490,
+	489, 488, 486, 486, 486, 486, 486, 486, 486, 486, 486, 486,
+	486, 486, 486, 486, 486, 486, 486, 486, 486, 486, 486, 486,
+	486, 486, 486, 486, 486, 486, 486, 486, 486, 486, 486, 486,
+	486, 486, 486, 486, 486, 486, 486,
+};
+
+const lut_t CELL_RES_LUT = { -25, 0, 91, CELL_RES_LUT_Y };
+
+static const int16_t CONT_DCL_LUT_Y[91] = {
+	110, 110, 110, 110, 110, 125, 125, 125, 125, 125, 140, 140,
+	140, 140, 140, 140, 140, 140, 140, 140, 140, 140, 140, 140,
+	140, 140, 140, 140, 140, 140, 140, 140, 140, 140, 140, 140,
+	140, 140, 140, 140, 140, 140, 140, 140, 140, 100, 100, 100,
+	100, 100, 60, 60, 60, 60, 60, 20, 20, 20, 20, 20,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0,
+};
+
+const lut_t CONT_DCL_LUT = { -25, 0, 91, CONT_DCL_LUT_Y };
+
+static const int16_t CONT_CCL_LUT_Y[91] = {
+	0, 0, 0, 0, 0, 25, 25, 25, 25, 25, 25, 25,
+	25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+	25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+	25, 25, 25, 25, 20, 20, 20, 20, 20, 15, 15, 15,
+	15, 15, 10, 10, 10, 10, 10, 5, 5, 5, 5, 5,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1,
+};
+
+const lut_t CONT_CCL_LUT = { -25, 0, 91, CONT_CCL_LUT_Y };
+
+static const int16_t FAN_LUT_Y[91] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	6, 12, 19, 25, 32, 38, 44, 51, 57, 64, 76, 89,
+	102, 115, 128, 153, 178, 204, 229, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255,
+};
+
+const lut_t FAN_LUT = { -25, 0, 91, FAN_LUT_Y };
+
+static const int16_t SOC_LUT_Y[533] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 1, 1, 1, 1, 1, 2, 2, 2,
+	2, 2, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4,
+	4, 5, 5, 5, 5, 5, 6, 6, 6, 7, 7, 7,
+	7, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 11,
+	11, 11, 11, 12, 12, 12, 13, 13, 13, 13, 14, 14,
+	14, 15, 15, 15, 16, 16, 16, 16, 17, 17, 17, 18,
+	18, 18, 18, 19, 19, 19, 20, 20, 20, 20, 21, 21,
+	21, 22, 22, 22, 22, 23, 23, 23, 24, 25, 26, 27,
+	28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39,
+	40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,
+	52, 53, 54, 56, 56, 57, 57, 58, 58, 59, 60, 60,
+	61, 61, 62, 62, 63, 64, 64, 65, 65, 66, 66, 67,
+	68, 68, 69, 69, 70, 70, 71, 72, 72, 73, 73, 74,
+	74, 74, 75, 75, 76, 76, 76, 77, 77, 77, 78, 78,
+	78, 79, 79, 79, 80, 80, 80, 81, 81, 82, 82, 82,
+	83, 83, 83, 84, 84, 84, 85, 85, 85, 86, 86, 86,
+	87, 87, 87, 88, 88, 88, 89, 89, 89, 89, 90, 90,
+	90, 91, 91, 91, 92, 92, 92, 93, 93, 93, 94, 94,
+	94, 95, 95, 95, 95, 95, 95, 95, 95, 95, 95, 95,
+	96, 96, 96, 96, 96, 96, 96, 96, 96, 96, 97, 97,
+	97, 97, 97, 97, 97, 97, 97, 97, 98, 98, 98, 98,
+	98, 98, 98, 98, 98, 98, 98, 98, 98, 98, 98, 98,
+	99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 100,
+};
+
+const lut_t SOC_LUT = { 25000, 5, 533, SOC_LUT_Y };
+
+static const int16_t OCV_LUT_Y[257] = {
+	3300, 3306, 3313, 3319, 3326, 3332, 3339, 3345, 3352, 3358, 3365, 3371,
+	3378, 3384, 3391, 3397, 3402, 3407, 3411, 3415, 3420, 3424, 3428, 3433,
+	3437, 3441, 3446, 3450, 3454, 3459, 3463, 3467, 3472, 3476, 3480, 3485,
+	3489, 3494, 3498, 3502, 3507, 3511, 3515, 3520, 3524, 3528, 3533, 3537,
+	3541, 3546, 3550, 3554, 3559, 3563, 3567, 3572, 3576, 3580, 3585, 3589,
+	3593, 3598, 3600, 3601, 3603, 3604, 3605, 3606, 3608, 3609, 3610, 3611,
+	3612, 3614, 3615, 3616, 3617, 3618, 3620, 3621, 3622, 3623, 3625, 3626,
+	3627, 3628, 3629, 3631, 3632, 3633, 3634, 3636, 3637, 3638, 3639, 3640,
+	3642, 3643, 3644, 3645, 3647, 3648, 3649, 3650, 3651, 3653, 3654, 3655,
+	3656, 3658, 3659, 3660, 3661, 3662, 3664, 3665, 3666, 3667, 3669, 3670,
+	3671, 3672, 3673, 3675, 3676, 3677, 3678, 3680, 3681, 3682, 3683, 3684,
+	3686, 3687, 3688, 3689, 3690, 3692, 3693, 3694, 3695, 3697, 3698, 3699,
+	3701, 3703, 3705, 3707, 3710, 3712, 3714, 3716, 3718, 3720, 3723, 3725,
+	3727, 3729, 3731, 3733, 3736, 3738, 3740, 3742, 3744, 3746, 3749, 3751,
+	3753, 3755, 3757, 3759, 3762, 3764, 3766, 3768, 3770, 3772, 3775, 3777,
+	3779, 3781, 3783, 3786, 3788, 3790, 3792, 3794, 3796, 3799, 3801, 3805,
+	3809, 3812, 3816, 3819, 3823, 3826, 3830, 3833, 3837, 3841, 3844, 3848,
+	3851, 3855, 3858, 3862, 3865, 3869, 3872, 3876, 3880, 3883, 3887, 3890,
+	3894, 3897, 3901, 3905, 3909, 3913, 3917, 3921, 3924, 3928, 3932, 3936,
+	3940, 3944, 3948, 3952, 3956, 3960, 3964, 3967, 3971, 3975, 3979, 3983,
+	3987, 3991, 3995, 3999, 4010, 4023, 4036, 4049, 4062, 4075, 4088, 4102,
+	4121, 4141, 4160, 4180, 4200,
+};
+
+const lut_t OCV_LUT = { 0, 4, 257, OCV_LUT_Y };
+
+static const int16_t THERM_LUT_Y[1025] = {
+	-250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250,
+	-250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250,
+	-250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250,
+	-250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250,
+	-250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250, -250,
+	-250, -250, -247, -244, -241, -239, -236, -233, -230, -228, -225, -223,
+	-220, -218, -216, -214, -212, -210, -208, -206, -204, -202, -200, -198,
+	-195, -193, -190, -188, -186, -184, -182, -180, -178, -176, -174, -172,
+	-170, -168, -166, -165, -163, -161, -160, -158, -156, -155, -153, -152,
+	-150, -148, -146, -144, -143, -141, -139, -137, -135, -134, -132, -130,
+	-128, -127, -125, -124, -122, -121, -119, -118, -116, -115, -113, -112,
+	-111, -109, -108, -107, -105, -104, -103, -102, -100, -99, -97, -96,
+	-94, -92, -91, -89, -88, -86, -85, -83, -82, -81, -79, -78,
+	-77, -75, -74, -73, -71, -70, -69, -68, -66, -65, -64, -63,
+	-62, -60, -59, -58, -57, -56, -55, -54, -53, -52, -51, -50,
+	-48, -47, -45, -44, -43, -42, -40, -39, -38, -36, -35, -34,
+	-33, -32, -30, -29, -28, -27, -26, -25, -23, -22, -21, -20,
+	-19, -18, -17, -16, -15, -14, -13, -12, -11, -10, -9, -8,
+	-7, -6, -5, -4, -3, -2, -1, 0, 1, 2, 3, 4,
+	5, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+	31, 32, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41,
+	41, 42, 43, 44, 45, 46, 47, 47, 48, 49, 50, 51,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
+	64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 74,
+	75, 76, 77, 78, 79, 80, 81, 82, 82, 83, 84, 85,
+	86, 87, 87, 88, 89, 90, 91, 91, 92, 93, 94, 95,
+	95, 96, 97, 98, 98, 99, 100, 101, 102, 103, 104, 105,
+	106, 107, 108, 109, 110, 110, 111, 112, 113, 114, 115, 116,
+	117, 118, 119, 120, 120, 121, 122, 123, 124, 125, 126, 126,
+	127, 128, 129, 130, 131, 131, 132, 133, 134, 135, 135, 136,
+	137, 138, 138, 139, 140, 141, 142, 142, 143, 144, 145, 145,
+	146, 147, 147, 148, 149, 150, 150, 151, 152, 153, 154, 155,
+	156, 157, 158, 159, 160, 161, 161, 162, 163, 164, 165, 166,
+	167, 168, 168, 169, 170, 171, 172, 173, 173, 174, 175, 176,
+	177, 178, 178, 179, 180, 181, 182, 182, 183, 184, 185, 185,
+	186, 187, 188, 189, 189, 190, 191, 192, 192, 193, 194, 194,
+	195, 196, 197, 197, 198, 199, 200, 200, 201, 202, 203, 204,
+	205, 206, 207, 208, 208, 209, 210, 211, 212, 213, 214, 215,
+	215, 216, 217, 218, 219, 220, 221, 221, 222, 223, 224, 225,
+	225, 226, 227, 228, 229, 230, 230, 231, 232, 233, 233, 234,
+	235, 236, 237, 237, 238, 239, 240, 240, 241, 242, 243, 243,
+	244, 245, 246, 246, 247, 248, 249, 249, 250, 251, 252, 253,
+	254, 255, 256, 256, 257, 258, 259, 260, 261, 262, 263, 264,
+	265, 265, 266, 267, 268, 269, 270, 271, 272, 272, 273, 274,
+	275, 276, 277, 277, 278, 279, 280, 281, 282, 282, 283, 284,
+	285, 286, 286, 287, 288, 289, 290, 290, 291, 292, 293, 294,
+	294, 295, 296, 297, 297, 298, 299, 300, 301, 302, 303, 303,
+	304, 305, 306, 307, 308, 309, 310, 311, 312, 313, 314, 315,
+	316, 317, 318, 319, 319, 320, 321, 322, 323, 324, 325, 326,
+	327, 327, 328, 329, 330, 331, 332, 333, 334, 334, 335, 336,
+	337, 338, 339, 340, 340, 341, 342, 343, 344, 345, 345, 346,
+	347, 348, 349, 349, 350, 351, 352, 353, 354, 356, 357, 358,
+	359, 360, 361, 362, 363, 364, 365, 366, 367, 368, 369, 370,
+	371, 372, 372, 373, 374, 375, 376, 377, 378, 379, 380, 381,
+	382, 383, 384, 385, 386, 387, 388, 389, 390, 390, 391, 392,
+	393, 394, 395, 396, 397, 398, 399, 399, 400, 402, 403, 404,
+	405, 406, 407, 408, 409, 411, 412, 413, 414, 415, 416, 417,
+	418, 419, 420, 421, 422, 424, 425, 426, 427, 428, 429, 430,
+	431, 432, 433, 434, 435, 436, 437, 438, 439, 440, 441, 442,
+	443, 444, 445, 446, 447, 448, 449, 450, 452, 453, 454, 455,
+	457, 458, 459, 460, 461, 463, 464, 465, 466, 468, 469, 470,
+	471, 472, 474, 475, 476, 477, 478, 479, 481, 482, 483, 484,
+	485, 486, 488, 489, 490, 491, 492, 493, 495, 496, 497, 498,
+	499, 500, 502, 503, 504, 506, 507, 509, 510, 511, 513, 514,
+	516, 517, 518, 520, 521, 522, 524, 525, 527, 528, 529, 531,
+	532, 533, 535, 536, 537, 539, 540, 541, 543, 544, 545, 546,
+	548, 549, 550, 552, 554, 555, 557, 559, 560, 562, 563, 565,
+	566, 568, 570, 571, 573, 574, 576, 577, 579, 580, 582, 584,
+	585, 587, 588, 590, 591, 593, 594, 596, 597, 599, 600, 602,
+	604, 606, 608, 610, 611, 613, 615, 617, 619, 621, 622, 624,
+	626, 628, 630, 631, 633, 635, 637, 639, 640, 642, 644, 646,
+	647, 649, 651, 653, 656, 658, 660, 662, 664, 666, 668, 671,
+	673, 675, 677, 679, 681, 683, 685, 687, 690, 692, 694, 696,
+	698, 700, 702, 705, 707, 710, 713, 715, 718, 720, 723, 725,
+	728, 730, 733, 735, 738, 740, 742, 745, 747, 750, 753, 756,
+	759, 762, 765, 768, 770, 773, 776, 779, 782, 785, 788, 791,
+	794, 797, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800,
+	800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800,
+	800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800,
+	800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800,
+	800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800,
+	800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800,
+	800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800,
+	800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800,
+	800, 800, 800, 800, 800,
+};
+
+const lut_t THERM_LUT = { 0, 2, 1025, THERM_LUT_Y };
+
+const uint32_t CELL_RES_RECIP[91] = {
+	303935, 311612, 319688, 328193, 337163, 346637, 354998, 363773,
+	372993, 382692, 392909, 404076, 415895, 428427, 441738, 455903,
+	469162, 483215, 498136, 514008, 530925, 545423, 560736, 576933,
+	594094, 612307, 627890, 644286, 661562, 679790, 699051, 715752,
+	733270, 751667, 771012, 791378, 801970, 812850, 824028, 835519,
+	847334, 852501, 857731, 863026, 868386, 873813, 875638, 877469,
+	879309, 881156, 883011, 883011, 883011, 883011, 883011, 883011,
+	883011, 883011, 883011, 883011, 883011, 883011, 883011, 883011,
+	883011, 883011, 883011, 883011, 883011, 883011, 883011, 883011,
+	883011, 883011, 883011, 883011, 883011, 883011, 883011, 883011,
+	883011, 883011, 883011, 883011, 883011, 883011, 883011, 883011,
+	883011, 883011, 883011,
+};
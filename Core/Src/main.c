@@ -16,11 +16,14 @@
 
 #include "segment.h"
 #include "compute.h"
+#include "coulomb.h"
+#include "eepromdirectory.h"
 #include "datastructs.h"
 #include "analyzer.h"
 #include "stateMachine.h"
 #include "can_handler.h"
 #include <stdio.h>
+#include <malloc.h>
 
 /* USER CODE END Includes */
 
@@ -59,6 +62,10 @@ IWDG_HandleTypeDef hiwdg;
 SPI_HandleTypeDef hspi1;
 SPI_HandleTypeDef hspi2;
 SPI_HandleTypeDef hspi3;
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
+DMA_HandleTypeDef hdma_spi2_rx;
+DMA_HandleTypeDef hdma_spi2_tx;
 
 TIM_HandleTypeDef htim1;
 TIM_HandleTypeDef htim2;
@@ -69,7 +76,11 @@ UART_HandleTypeDef huart4;
 PCD_HandleTypeDef hpcd_USB_OTG_FS;
 
 /* USER CODE BEGIN PV */
-acc_data_t *prev_acc_data = NULL;
+
+/* The fan cooling each segment, a pack with more segments has to say which fans they share */
+static const fan_select_t segment_fan[] = { FAN1, FAN2, FAN3, FAN4, FAN5, FAN6 };
+_Static_assert(sizeof(segment_fan) / sizeof(segment_fan[0]) == NUM_SEGMENTS, "segment_fan has to cover every segment");
+
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -141,8 +152,19 @@ const void print_bms_stats(acc_data_t *acc_data)
   printf("DCL: %d\r\n", acc_data->discharge_limit);
   printf("CCL: %d\r\n", acc_data->charge_limit);
   printf("Cont CCL %d\r\n", acc_data->cont_CCL);
-  printf("SoC: %d\r\n", acc_data->soc);
+  printf("DCL peak, short, cont: %d, %d, %d\r\n", acc_data->dcl_horizon[LIMIT_PEAK], acc_data->dcl_horizon[LIMIT_SHORT], acc_data->dcl_horizon[LIMIT_CONT]);
+  printf("CCL peak, short, cont: %d, %d, %d\r\n", acc_data->ccl_horizon[LIMIT_PEAK], acc_data->ccl_horizon[LIMIT_SHORT], acc_data->ccl_horizon[LIMIT_CONT]);
+  printf("SoC: %d +- %d\r\n", acc_data->soc, acc_data->soc_bound);
+  printf("Pack Ah * 10, Discharged, Charged (mAh): %d, %lu, %lu\r\n", acc_data->pack_ah, acc_data->discharged, acc_data->charged);
   printf("Is Balancing?: %d\r\n", segment_is_balancing());
+  printf("Heap In Use: %d\r\n", mallinfo().uordblks); /* should stay flat after boot */
+  printf("Separate Acq Bytes, Latency (us): %lu, %lu\r\n", segment_get_acq_stats(SEGMENT_ACQ_SEPARATE)->bytes, segment_get_acq_stats(SEGMENT_ACQ_SEPARATE)->latency_us);
+  printf("Combined Acq Bytes, Latency (us): %lu, %lu\r\n", segment_get_acq_stats(SEGMENT_ACQ_COMBINED)->bytes, segment_get_acq_stats(SEGMENT_ACQ_COMBINED)->latency_us);
+  printf("Analysis Stages Run/Skipped: ");
+  for (uint8_t stage = 0; stage < NUM_ANALYSIS_STAGES; stage++) {
+    printf("%lu/%lu ", analyzer_get_stage_stats(stage)->executed, analyzer_get_stage_stats(stage)->skipped);
+  }
+  printf("\r\n");
   printf("State: ");
   if (current_state == 0) printf("BOOT\r\n");
   else if (current_state == 1) printf("READY\r\n");
@@ -162,7 +184,7 @@ const void print_bms_stats(acc_data_t *acc_data)
   {
     for(uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++)
     {
-        printf("%d\t", acc_data->chip_data[c].voltage[cell]);
+        printf("%d\t", CELL_VOLTAGE(acc_data, c, cell));
     }
     printf("\r\n");
   }
@@ -172,7 +194,7 @@ const void print_bms_stats(acc_data_t *acc_data)
   {
     for(uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++)
     {
-        printf("%d\t", acc_data->chip_data[c].open_cell_voltage[cell]);
+        printf("%d\t", CELL_OCV(acc_data, c, cell));
     }
     printf("\r\n");
   }
@@ -211,7 +233,7 @@ const void print_bms_stats(acc_data_t *acc_data)
 
     for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
 
-          printf("%d ", acc_data->chip_data[c].cell_temp[cell]);
+          printf("%d ", CELL_TEMP(acc_data, c, cell));
         }
       
         printf("\r\n");
@@ -231,7 +253,8 @@ const void print_bms_stats(acc_data_t *acc_data)
 int main(void)
 {
   /* USER CODE BEGIN 1 */
-
+  /* Pack current when the last cell conversion was started */
+  int16_t conversion_current = 0;
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -283,6 +306,7 @@ int main(void)
   HAL_Delay(500);
   //watchdog_init();
   segment_init();
+  eepromInit();
   compute_init();
   
   /* USER CODE END 2 */
@@ -290,11 +314,11 @@ int main(void)
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
   for(;;) {
-    /* Create a dynamically allocated structure */
+    /* Grab a zeroed frame out of the analyzer's static pool */
 
     //TODO add ISR/timer based debug LED toggle
 
-    acc_data_t *acc_data = malloc(sizeof(acc_data_t));
+    acc_data_t *acc_data = analyzer_acquire_frame();
     acc_data->is_charger_connected = false;
     acc_data->fault_code = FAULTS_CLEAR;
 
@@ -302,8 +326,25 @@ int main(void)
      * Collect all the segment data needed to perform analysis
      * Not state specific
      */
-    segment_retrieve_data(acc_data->chip_data);
+    segment_collect(acc_data->chip_data);
+    acc_data->timestamp = HAL_GetTick();
+    acc_data->generation[FRAME_SRC_VOLTAGE] = segment_get_voltage_generation();
+    acc_data->generation[FRAME_SRC_THERM] = segment_get_therm_generation();
+
+    /* The voltages of a new generation come from the last conversion started, pair them with its current */
+    acc_data->voltage_current = conversion_current;
+
+    /* Kick off the next cell conversion so it runs while we read current, check faults and send CAN */
+    bool converting = segment_start_conversion();
     acc_data->pack_current = compute_get_pack_current();
+    if (converting)
+      conversion_current = acc_data->pack_current;
+    acc_data->generation[FRAME_SRC_CURRENT] = compute_get_current_generation();
+    acc_data->discharged = coulomb_get_discharged();
+    acc_data->charged = coulomb_get_charged();
+    acc_data->net_discharged = coulomb_get_net_mas();
+    for (uint8_t seg = 0; seg < NUM_SEGMENTS; seg++)
+      acc_data->fan_duty[seg] = compute_get_fan_speed(segment_fan[seg]);
 
     analyzer_push(acc_data);
     sm_handle_state(acc_data);
@@ -312,6 +353,8 @@ int main(void)
     //get_can1_msg();
     //get_can2_msg();
 
+    coulomb_save();
+
     #ifdef DEBUG_STATS
     print_bms_stats(acc_data);
     #endif
@@ -387,6 +430,7 @@ static void MX_ADC1_Init(void)
 
   /* USER CODE END ADC1_Init 0 */
 
+  ADC_MultiModeTypeDef multimode = {0};
   ADC_ChannelConfTypeDef sConfig = {0};
 
   /* USER CODE BEGIN ADC1_Init 1 */
@@ -398,25 +442,44 @@ static void MX_ADC1_Init(void)
   hadc1.Instance = ADC1;
   hadc1.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV2;
   hadc1.Init.Resolution = ADC_RESOLUTION_12B;
-  hadc1.Init.ScanConvMode = DISABLE;
+  hadc1.Init.ScanConvMode = ENABLE;
   hadc1.Init.ContinuousConvMode = DISABLE;
   hadc1.Init.DiscontinuousConvMode = DISABLE;
-  hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
-  hadc1.Init.ExternalTrigConv = ADC_SOFTWARE_START;
+  hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+  hadc1.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_TRGO;
   hadc1.Init.DataAlign = ADC_DATAALIGN_RIGHT;
-  hadc1.Init.NbrOfConversion = 1;
+  hadc1.Init.NbrOfConversion = 2;
   hadc1.Init.DMAContinuousRequests = ENABLE;
-  hadc1.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+  hadc1.Init.EOCSelection = ADC_EOC_SEQ_CONV;
   if (HAL_ADC_Init(&hadc1) != HAL_OK)
   {
     Error_Handler();
   }
 
+  /** Configure the ADC multi-mode
+  */
+  multimode.Mode = ADC_DUALMODE_REGSIMULT;
+  multimode.DMAAccessMode = ADC_DMAACCESSMODE_2;
+  multimode.TwoSamplingDelay = ADC_TWOSAMPLINGDELAY_5CYCLES;
+  if (HAL_ADCEx_MultiModeConfigChannel(&hadc1, &multimode) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
   /** Configure for the selected ADC regular channel its corresponding rank in the sequencer and its sample time.
   */
   sConfig.Channel = ADC_CHANNEL_15;
   sConfig.Rank = 1;
-  sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
+  sConfig.SamplingTime = ADC_SAMPLETIME_84CYCLES;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /** Configure for the selected ADC regular channel its corresponding rank in the sequencer and its sample time.
+  */
+  sConfig.Channel = ADC_CHANNEL_9;
+  sConfig.Rank = 2;
   if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
   {
     Error_Handler();
@@ -450,15 +513,15 @@ static void MX_ADC2_Init(void)
   hadc2.Instance = ADC2;
   hadc2.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV2;
   hadc2.Init.Resolution = ADC_RESOLUTION_12B;
-  hadc2.Init.ScanConvMode = DISABLE;
+  hadc2.Init.ScanConvMode = ENABLE;
   hadc2.Init.ContinuousConvMode = DISABLE;
   hadc2.Init.DiscontinuousConvMode = DISABLE;
   hadc2.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
   hadc2.Init.ExternalTrigConv = ADC_SOFTWARE_START;
   hadc2.Init.DataAlign = ADC_DATAALIGN_RIGHT;
-  hadc2.Init.NbrOfConversion = 1;
+  hadc2.Init.NbrOfConversion = 2;
   hadc2.Init.DMAContinuousRequests = DISABLE;
-  hadc2.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+  hadc2.Init.EOCSelection = ADC_EOC_SEQ_CONV;
   if (HAL_ADC_Init(&hadc2) != HAL_OK)
   {
     Error_Handler();
@@ -468,7 +531,15 @@ static void MX_ADC2_Init(void)
   */
   sConfig.Channel = ADC_CHANNEL_8;
   sConfig.Rank = 1;
-  sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
+  sConfig.SamplingTime = ADC_SAMPLETIME_84CYCLES;
+  if (HAL_ADC_ConfigChannel(&hadc2, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /** Configure for the selected ADC regular channel its corresponding rank in the sequencer and its sample time.
+  */
+  sConfig.Rank = 2;
   if (HAL_ADC_ConfigChannel(&hadc2, &sConfig) != HAL_OK)
   {
     Error_Handler();
@@ -827,9 +898,9 @@ static void MX_TIM2_Init(void)
 
   /* USER CODE END TIM2_Init 1 */
   htim2.Instance = TIM2;
-  htim2.Init.Prescaler = 0;
+  htim2.Init.Prescaler = 15;
   htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
-  htim2.Init.Period = 4294967295;
+  htim2.Init.Period = 249;
   htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
   htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
   if (HAL_TIM_Base_Init(&htim2) != HAL_OK)
@@ -841,7 +912,7 @@ static void MX_TIM2_Init(void)
   {
     Error_Handler();
   }
-  sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_UPDATE;
   sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
   if (HAL_TIMEx_MasterConfigSynchronization(&htim2, &sMasterConfig) != HAL_OK)
   {
@@ -1015,12 +1086,25 @@ static void MX_DMA_Init(void)
 {
 
   /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
   __HAL_RCC_DMA2_CLK_ENABLE();
 
   /* DMA interrupt init */
+  /* DMA1_Stream3_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Stream3_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream3_IRQn);
+  /* DMA1_Stream4_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Stream4_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream4_IRQn);
   /* DMA2_Stream0_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 0, 0);
   HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+  /* DMA2_Stream2_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA2_Stream2_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+  /* DMA2_Stream3_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA2_Stream3_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream3_IRQn);
 
 }
 
@@ -0,0 +1,114 @@
+#include "pec15.h"
+
+/*
+ * Both tables are for the LTC6804's CRC15 polynomial (0x4599) and live in flash.
+ * PEC15_TABLE is the standard byte at a time table. PEC15_SLICE_TABLE folds the first of two
+ * bytes forward through a second step, since the CRC is linear:
+ *   PEC15_SLICE_TABLE[x] = (PEC15_TABLE[x] << 8) ^ PEC15_TABLE[(PEC15_TABLE[x] >> 7) & 0xFF]
+ * so two bytes only need one lookup in each.
+ */
+static const uint16_t PEC15_TABLE[256] = {
+	0x0000, 0xC599, 0xCEAB, 0x0B32, 0xD8CF, 0x1D56, 0x1664, 0xD3FD,
+	0xF407, 0x319E, 0x3AAC, 0xFF35, 0x2CC8, 0xE951, 0xE263, 0x27FA,
+	0xAD97, 0x680E, 0x633C, 0xA6A5, 0x7558, 0xB0C1, 0xBBF3, 0x7E6A,
+	0x5990, 0x9C09, 0x973B, 0x52A2, 0x815F, 0x44C6, 0x4FF4, 0x8A6D,
+	0x5B2E, 0x9EB7, 0x9585, 0x501C, 0x83E1, 0x4678, 0x4D4A, 0x88D3,
+	0xAF29, 0x6AB0, 0x6182, 0xA41B, 0x77E6, 0xB27F, 0xB94D, 0x7CD4,
+	0xF6B9, 0x3320, 0x3812, 0xFD8B, 0x2E76, 0xEBEF, 0xE0DD, 0x2544,
+	0x02BE, 0xC727, 0xCC15, 0x098C, 0xDA71, 0x1FE8, 0x14DA, 0xD143,
+	0xF3C5, 0x365C, 0x3D6E, 0xF8F7, 0x2B0A, 0xEE93, 0xE5A1, 0x2038,
+	0x07C2, 0xC25B, 0xC969, 0x0CF0, 0xDF0D, 0x1A94, 0x11A6, 0xD43F,
+	0x5E52, 0x9BCB, 0x90F9, 0x5560, 0x869D, 0x4304, 0x4836, 0x8DAF,
+	0xAA55, 0x6FCC, 0x64FE, 0xA167, 0x729A, 0xB703, 0xBC31, 0x79A8,
+	0xA8EB, 0x6D72, 0x6640, 0xA3D9, 0x7024, 0xB5BD, 0xBE8F, 0x7B16,
+	0x5CEC, 0x9975, 0x9247, 0x57DE, 0x8423, 0x41BA, 0x4A88, 0x8F11,
+	0x057C, 0xC0E5, 0xCBD7, 0x0E4E, 0xDDB3, 0x182A, 0x1318, 0xD681,
+	0xF17B, 0x34E2, 0x3FD0, 0xFA49, 0x29B4, 0xEC2D, 0xE71F, 0x2286,
+	0xA213, 0x678A, 0x6CB8, 0xA921, 0x7ADC, 0xBF45, 0xB477, 0x71EE,
+	0x5614, 0x938D, 0x98BF, 0x5D26, 0x8EDB, 0x4B42, 0x4070, 0x85E9,
+	0x0F84, 0xCA1D, 0xC12F, 0x04B6, 0xD74B, 0x12D2, 0x19E0, 0xDC79,
+	0xFB83, 0x3E1A, 0x3528, 0xF0B1, 0x234C, 0xE6D5, 0xEDE7, 0x287E,
+	0xF93D, 0x3CA4, 0x3796, 0xF20F, 0x21F2, 0xE46B, 0xEF59, 0x2AC0,
+	0x0D3A, 0xC8A3, 0xC391, 0x0608, 0xD5F5, 0x106C, 0x1B5E, 0xDEC7,
+	0x54AA, 0x9133, 0x9A01, 0x5F98, 0x8C65, 0x49FC, 0x42CE, 0x8757,
+	0xA0AD, 0x6534, 0x6E06, 0xAB9F, 0x7862, 0xBDFB, 0xB6C9, 0x7350,
+	0x51D6, 0x944F, 0x9F7D, 0x5AE4, 0x8919, 0x4C80, 0x47B2, 0x822B,
+	0xA5D1, 0x6048, 0x6B7A, 0xAEE3, 0x7D1E, 0xB887, 0xB3B5, 0x762C,
+	0xFC41, 0x39D8, 0x32EA, 0xF773, 0x248E, 0xE117, 0xEA25, 0x2FBC,
+	0x0846, 0xCDDF, 0xC6ED, 0x0374, 0xD089, 0x1510, 0x1E22, 0xDBBB,
+	0x0AF8, 0xCF61, 0xC453, 0x01CA, 0xD237, 0x17AE, 0x1C9C, 0xD905,
+	0xFEFF, 0x3B66, 0x3054, 0xF5CD, 0x2630, 0xE3A9, 0xE89B, 0x2D02,
+	0xA76F, 0x62F6, 0x69C4, 0xAC5D, 0x7FA0, 0xBA39, 0xB10B, 0x7492,
+	0x5368, 0x96F1, 0x9DC3, 0x585A, 0x8BA7, 0x4E3E, 0x450C, 0x8095,
+};
+
+static const uint16_t PEC15_SLICE_TABLE[256] = {
+	0x0000, 0xC426, 0x4DD5, 0x89F3, 0x5E33, 0x9A15, 0x13E6, 0xD7C0,
+	0xF9FF, 0x3DD9, 0xB42A, 0x700C, 0xA7CC, 0x63EA, 0xEA19, 0x2E3F,
+	0x3667, 0xF241, 0x7BB2, 0xBF94, 0x6854, 0xAC72, 0x2581, 0xE1A7,
+	0xCF98, 0x0BBE, 0x824D, 0x466B, 0x91AB, 0x558D, 0xDC7E, 0x1858,
+	0x6CCE, 0xA8E8, 0x211B, 0xE53D, 0x32FD, 0xF6DB, 0x7F28, 0xBB0E,
+	0x9531, 0x5117, 0xD8E4, 0x1CC2, 0xCB02, 0x0F24, 0x86D7, 0x42F1,
+	0x5AA9, 0x9E8F, 0x177C, 0xD35A, 0x049A, 0xC0BC, 0x494F, 0x8D69,
+	0xA356, 0x6770, 0xEE83, 0x2AA5, 0xFD65, 0x3943, 0xB0B0, 0x7496,
+	0x1C05, 0xD823, 0x51D0, 0x95F6, 0x4236, 0x8610, 0x0FE3, 0xCBC5,
+	0xE5FA, 0x21DC, 0xA82F, 0x6C09, 0xBBC9, 0x7FEF, 0xF61C, 0x323A,
+	0x2A62, 0xEE44, 0x67B7, 0xA391, 0x7451, 0xB077, 0x3984, 0xFDA2,
+	0xD39D, 0x17BB, 0x9E48, 0x5A6E, 0x8DAE, 0x4988, 0xC07B, 0x045D,
+	0x70CB, 0xB4ED, 0x3D1E, 0xF938, 0x2EF8, 0xEADE, 0x632D, 0xA70B,
+	0x8934, 0x4D12, 0xC4E1, 0x00C7, 0xD707, 0x1321, 0x9AD2, 0x5EF4,
+	0x46AC, 0x828A, 0x0B79, 0xCF5F, 0x189F, 0xDCB9, 0x554A, 0x916C,
+	0xBF53, 0x7B75, 0xF286, 0x36A0, 0xE160, 0x2546, 0xACB5, 0x6893,
+	0x380A, 0xFC2C, 0x75DF, 0xB1F9, 0x6639, 0xA21F, 0x2BEC, 0xEFCA,
+	0xC1F5, 0x05D3, 0x8C20, 0x4806, 0x9FC6, 0x5BE0, 0xD213, 0x1635,
+	0x0E6D, 0xCA4B, 0x43B8, 0x879E, 0x505E, 0x9478, 0x1D8B, 0xD9AD,
+	0xF792, 0x33B4, 0xBA47, 0x7E61, 0xA9A1, 0x6D87, 0xE474, 0x2052,
+	0x54C4, 0x90E2, 0x1911, 0xDD37, 0x0AF7, 0xCED1, 0x4722, 0x8304,
+	0xAD3B, 0x691D, 0xE0EE, 0x24C8, 0xF308, 0x372E, 0xBEDD, 0x7AFB,
+	0x62A3, 0xA685, 0x2F76, 0xEB50, 0x3C90, 0xF8B6, 0x7145, 0xB563,
+	0x9B5C, 0x5F7A, 0xD689, 0x12AF, 0xC56F, 0x0149, 0x88BA, 0x4C9C,
+	0x240F, 0xE029, 0x69DA, 0xADFC, 0x7A3C, 0xBE1A, 0x37E9, 0xF3CF,
+	0xDDF0, 0x19D6, 0x9025, 0x5403, 0x83C3, 0x47E5, 0xCE16, 0x0A30,
+	0x1268, 0xD64E, 0x5FBD, 0x9B9B, 0x4C5B, 0x887D, 0x018E, 0xC5A8,
+	0xEB97, 0x2FB1, 0xA642, 0x6264, 0xB5A4, 0x7182, 0xF871, 0x3C57,
+	0x48C1, 0x8CE7, 0x0514, 0xC132, 0x16F2, 0xD2D4, 0x5B27, 0x9F01,
+	0xB13E, 0x7518, 0xFCEB, 0x38CD, 0xEF0D, 0x2B2B, 0xA2D8, 0x66FE,
+	0x7EA6, 0xBA80, 0x3373, 0xF755, 0x2095, 0xE4B3, 0x6D40, 0xA966,
+	0x8759, 0x437F, 0xCA8C, 0x0EAA, 0xD96A, 0x1D4C, 0x94BF, 0x5099,
+};
+
+uint16_t pec15_compute(uint8_t len, const uint8_t* data)
+{
+	uint16_t remainder = 16; /* PEC seed */
+	uint8_t i		   = 0;
+
+	for (; i + 1 < len; i += 2) {
+		remainder = PEC15_SLICE_TABLE[((remainder >> 7) ^ data[i]) & 0xFF]
+			^ PEC15_TABLE[((remainder << 1) ^ data[i + 1]) & 0xFF];
+	}
+
+	/* Odd byte out */
+	if (i < len)
+		remainder = (remainder << 8) ^ PEC15_TABLE[((remainder >> 7) ^ data[i]) & 0xFF];
+
+	/* The CRC15 has a 0 in the LSB */
+	return (uint16_t)(remainder << 1);
+}
+
+uint8_t pec15_verify_chain(const uint8_t* buf, uint8_t num_chips, uint32_t* failed_mask)
+{
+	uint8_t num_failed = 0;
+	*failed_mask	   = 0;
+
+	for (uint8_t chip = 0; chip < num_chips; chip++) {
+		const uint8_t* reg	  = &buf[chip * PEC15_REG_STRIDE];
+		uint16_t received_pec = (reg[PEC15_DATA_LEN] << 8) | reg[PEC15_DATA_LEN + 1];
+
+		if (pec15_compute(PEC15_DATA_LEN, reg) != received_pec) {
+			*failed_mask |= 1u << chip;
+			num_failed++;
+		}
+	}
+
+	return num_failed;
+}
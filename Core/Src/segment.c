@@ -3,27 +3,154 @@
 #include <string.h>
 #include <stdlib.h>
 #include "main.h"
+#include "ltc_dma.h"
+#include "pec15.h"
+#include "thermistor.h"
 #include <math.h>
 
-#define THERM_WAIT_TIME		 500 /* ms */
+#define THERM_SETTLE_TIME	 200 /* ms, mux output settling after a channel change */
 #define VOLTAGE_WAIT_TIME	 100 /* ms */
+#define CONV_TIME_MARGIN	 20	 /* us, covers the tolerance of the LTC6804's ADC clock */
+#define REF_STARTUP_TIME	 4400 /* us, worst case tREFUP after REFON is set */
 #define THERM_AVG			 15	 /* Number of values to average */
 #define MAX_VOLT_DELTA		 2500
 #define MAX_CONSEC_NOISE	 10
 #define GPIO_EXPANDER_ADDR   0x40
 #define GPIO_REGISTER_ADDR   0x09
+#define NUM_RDCV_GROUPS		 4	 /* cell voltage register groups A through D */
+#define AUX_GROUP			 NUM_RDCV_GROUPS /* aux group A follows the cell groups in a combined readback */
+#define NUM_READ_GROUPS		 (NUM_RDCV_GROUPS + 1)
+#define ALL_CELL_GROUPS		 ((1 << NUM_RDCV_GROUPS) - 1)
+#define ALL_GROUPS_WITH_AUX	 ((1 << NUM_READ_GROUPS) - 1)
+#define ALL_CHIPS			 (UINT32_MAX >> (32 - NUM_CHIPS))
+#define MAX_GROUP_RETRIES	 2	 /* re-reads of a failing group before falling back to the last good read */
+#define CONFIG_VERIFY_TIME	 1000 /* ms between background readbacks of the chip configuration */
+#define CFGR0_READBACK_MASK	 0x05 /* REFON and ADCOPT, the GPIO bits read back pin levels instead */
+#define REF_REFRESH_THERM	 1	 /* mux channel that always takes the ADAX path, refreshing the GPIO3 5V ref */
+
+#ifndef SEGMENT_ACQ_MODE
+#define SEGMENT_ACQ_MODE SEGMENT_ACQ_COMBINED
+#endif
 
-//TODO ensure spi 1 is correct for talking to segs
 extern SPI_HandleTypeDef hspi1;
-ltc_config* ltc68041;
-
+extern SPI_HandleTypeDef hspi2;
+
+/* A run of the daisy chain hanging off one SPI bus */
+typedef struct {
+	SPI_HandleTypeDef* hspi;
+	GPIO_TypeDef* cs_port;
+	uint16_t cs_pin;
+	uint8_t num_chips;
+	uint8_t mapping[NUM_CHIPS]; /* index into segment_data of each chip on the bus, in chain order */
+} segment_bus_t;
+
+/*
+ * Chips are numbered in bus order and then chain order, so the chips of a bus are a contiguous
+ * range of every per-chip array here. Our segments are mapped backwards and in pairs, so they
+ * are read in 1,0 then 3,2, etc
+ */
+#if NUM_SPI_BUSES == 1
+#define BUS_1_CHIPS		12
+#define BUS_TABLE_CHIPS BUS_1_CHIPS
+const segment_bus_t bus_table[NUM_SPI_BUSES] = {
+	{&hspi1, SPI_1_CS_GPIO_Port, SPI_1_CS_Pin, BUS_1_CHIPS, {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10}},
+};
+#elif NUM_SPI_BUSES == 2
+#define BUS_1_CHIPS		6
+#define BUS_2_CHIPS		6
+#define BUS_TABLE_CHIPS (BUS_1_CHIPS + BUS_2_CHIPS)
+const segment_bus_t bus_table[NUM_SPI_BUSES] = {
+	{&hspi1, SPI_1_CS_GPIO_Port, SPI_1_CS_Pin, BUS_1_CHIPS, {1, 0, 3, 2, 5, 4}},
+	{&hspi2, SPI_2_CS_GPIO_Port, SPI_2_CS_Pin, BUS_2_CHIPS, {7, 6, 9, 8, 11, 10}},
+};
+#else
+#error "No bus_table for this NUM_SPI_BUSES"
+#endif
+
+_Static_assert(BUS_TABLE_CHIPS == NUM_CHIPS, "bus_table has to cover every chip");
+_Static_assert(NUM_CHIPS <= 32, "chip masks are a bit per chip in a uint32_t");
+
+ltc_config bus_ltc[NUM_SPI_BUSES];
+uint8_t bus_first_chip[NUM_SPI_BUSES];
+uint32_t bus_chips[NUM_SPI_BUSES]; /* bit per chip on the bus */
+
+/* Cell voltage readback is streamed over DMA on every bus at once, everything else still uses polled transfers */
+ltc_dma_t bus_dma[NUM_SPI_BUSES];
+const uint16_t read_cmds[NUM_READ_GROUPS] = {LTC_CMD_RDCVA, LTC_CMD_RDCVB, LTC_CMD_RDCVC, LTC_CMD_RDCVD, LTC_CMD_RDAUXA};
+
+/* Codes of the readback in progress, 3 per group, cell groups first and then aux group A */
+uint16_t raw_codes[NUM_CHIPS][NUM_READ_GROUPS * 3];
+uint32_t group_failures[NUM_READ_GROUPS]; /* bit per chip that hasn't gotten a group through PEC yet */
+uint8_t read_groups[NUM_SPI_BUSES][NUM_READ_GROUPS]; /* groups in each bus' transfer in flight, in command order */
+uint8_t num_read_groups[NUM_SPI_BUSES] = {};
+uint8_t group_retries = 0;
+uint32_t read_bytes = 0;
+
+/* Indexed the same as segment_data, not by position in the daisy chain */
+link_stats_t link_stats[NUM_CHIPS] = {};
+
+segment_acq_mode_t acq_mode = SEGMENT_ACQ_MODE;
+
+/* ADC speed and discharge permission used for every conversion, see segment_set_adc_mode() */
+uint8_t adc_md = MD_NORMAL;
+uint8_t adc_dcp = DCP_DISABLED;
+
+/* Datasheet conversion times in us, indexed by MD (with ADCOPT = 0, MD 0 is 422Hz) */
+const uint32_t ADCV_CONV_TIME[4] = {12807, 1113, 2335, 201317};	/* all cells */
+const uint32_t ADAX_CONV_TIME[4] = {12807, 1113, 2335, 201317};	/* all GPIOs and the 2nd ref */
+const uint32_t ADCVAX_CONV_TIME[4] = {16697, 1564, 3064, 268405}; /* all cells plus GPIO1/2 */
+
+segment_acq_stats_t acq_stats[SEGMENT_ACQ_NUM_MODES] = {};
+
+/* Bumped every time a completed acquisition is decoded, see frame_source_t */
+uint16_t voltage_generation = 0;
+uint16_t therm_generation = 0;
+
+/* Set when the conversion in flight also converted the thermistor mux outputs */
+bool conversion_has_aux = false;
+uint32_t conversion_start_cycle = 0;
+uint32_t conversion_time = 0;
+uint32_t voltage_frame_bytes = 0;
+uint32_t voltage_frame_cycles = 0;
+uint32_t therm_conversion_start_cycle = 0;
+uint32_t therm_conversion_time = 0;
+
+/* Thermistor voltages from a combined conversion, waiting on the thermistor scan to pick them up */
+uint16_t combined_aux[NUM_CHIPS][6];
+bool combined_aux_ready = false;
+
+/*
+ * Shadow of the chip config registers. local_config is what we want on the chips,
+ * written_config is what was last sent to them
+ */
 uint8_t local_config[NUM_CHIPS][6] = {};
+uint8_t written_config[NUM_CHIPS][6] = {};
+uint32_t config_dirty = 0; /* bit per chip that needs to be rewritten */
+uint32_t config_write_cycle = 0; /* when WRCFG last went out, the reference restarts on a chip that had reset */
+nertimer_t config_verify_timer;
 uint8_t therm_avg_counter = 0;
 
 chipdata_t *segment_data = NULL;
 chipdata_t previous_data[NUM_CHIPS] = {};
 uint16_t discharge_commands[NUM_CHIPS] = {};
 
+/* Stages of a single thermistor mux channel acquisition */
+typedef enum {
+	THERM_SELECT,  /* mux channel needs to be selected */
+	THERM_SETTLE,  /* waiting on the mux output to settle */
+	THERM_CONVERT, /* waiting on the ADAX conversion */
+} therm_scan_state_t;
+
+/* Stages of a cell voltage acquisition */
+typedef enum {
+	VOLTAGE_IDLE,		/* waiting on the next sample period */
+	VOLTAGE_CONVERTING, /* ADCV was broadcast, waiting on the conversion */
+	VOLTAGE_READING,	/* cell codes are streaming back over DMA */
+} voltage_acq_state_t;
+
+therm_scan_state_t therm_scan_state = THERM_SELECT;
+voltage_acq_state_t voltage_state = VOLTAGE_IDLE;
+uint8_t current_therm = 1;
 nertimer_t therm_timer;
 nertimer_t voltage_reading_timer;
 nertimer_t variance_timer;
@@ -31,53 +158,96 @@ nertimer_t variance_timer;
 int voltage_error = 0; //not faulted
 int therm_error = 0; //not faulted
 
-/* our segments are mapped backwards and in pairs, so they are read in 1,0 then 3,2, etc*/
-const int mapping_correction[12] = {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10};
+/* Merged from the bus_table mappings, indexed by chip number */
+uint8_t mapping_correction[NUM_CHIPS];
 
 uint16_t therm_settle_time_ = 0;
 
-const uint32_t VOLT_TEMP_CONV[106] = {
-157300, 148800, 140300, 131800, 123300, 114800, 108772, 102744, 96716, 90688, 84660, 80328, 75996, 71664, 67332,
-63000, 59860, 56720, 53580, 50440, 47300, 45004, 42708, 40412, 38116, 35820, 34124, 32428, 30732, 29036, 27340,
-26076, 24812, 23548, 22284, 21020, 20074, 19128, 18182, 17236, 16290, 15576, 14862, 14148, 13434, 12720, 12176,
-11632, 11088, 10544, 10000, 9584, 9168, 8753, 8337, 7921, 7600, 7279, 6957, 6636, 6315, 6065, 5816, 5566, 5317,
-5067, 4872, 4676, 4481, 4285, 4090, 3936, 3782, 3627, 3473, 3319, 3197, 3075, 2953, 2831, 2709, 2612, 2514, 2417,
-2319, 2222, 2144, 2066, 1988, 1910, 1832, 1769, 1706, 1644, 1581, 1518, 1467, 1416, 1366, 1315, 1264, 1223, 1181, 1140, 1098, 1057};
-
-const int32_t VOLT_TEMP_CALIB_OFFSET = 0;
-
 /* private function prototypes */
 void serialize_i2c_msg(uint8_t data_to_write[][3], uint8_t comm_output[][6]);
-int8_t steinhart_est(uint16_t V);
 void variance_therm_check(void);
 void discard_neutrals(void);
-void pull_chip_configuration(void);
+void verify_chip_configuration(void);
 int16_t calc_average(void);
 int8_t calc_therm_standard_dev(int16_t avg_temp);
+void decode_group(uint8_t bus, const ltc_dma_frame_t* frame, uint8_t cmd, uint8_t group);
+int start_group_read(uint8_t bus, uint8_t groups);
+bool buses_busy(void);
+void wait_buses(void);
+void write_comm(uint8_t comm_reg_data[][6]);
+void process_voltages(void);
+void process_thermistors(uint16_t raw_temp_voltages[NUM_CHIPS][6]);
+void advance_therm_scan(void);
+void record_acq_frame(segment_acq_mode_t mode, uint32_t bytes, uint32_t cycles);
+bool conversion_elapsed(uint32_t start_cycle, uint32_t time_us);
+uint32_t ref_startup_time(uint32_t start_cycle);
+
+void push_chip_configuration()
+{
+	for (uint8_t chip = 0; chip < NUM_CHIPS; chip++) {
+		if (memcmp(local_config[chip], written_config[chip], sizeof(local_config[chip])))
+			config_dirty |= 1u << chip;
+	}
 
-void push_chip_configuration() { LTC6804_wrcfg(ltc68041, NUM_CHIPS, local_config); }
+	/* WRCFG always goes out to a whole bus, so only send it to buses where something actually changed */
+	if (!config_dirty)
+		return;
+
+	wait_buses();
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		if (config_dirty & bus_chips[bus])
+			LTC6804_wrcfg(&bus_ltc[bus], bus_table[bus].num_chips, &local_config[bus_first_chip[bus]]);
+	}
+
+	memcpy(written_config, local_config, sizeof(written_config));
+	config_dirty	   = 0;
+	config_write_cycle = DWT->CYCCNT;
+}
 
 void segment_init()
 {
 	printf("Initializing Segments...");
 
-	ltc68041 = malloc(sizeof(ltc_config));
-	LTC6804_initialize(ltc68041, &hspi1, GPIOA, SPI_1_CS_Pin);
+	uint8_t first_chip = 0;
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		const segment_bus_t* cfg = &bus_table[bus];
+
+		/* The other SPIs come up in mode 0 for other peripherals, isoSPI needs SPI1's settings */
+		if (cfg->hspi != &hspi1) {
+			cfg->hspi->Init.CLKPolarity		  = hspi1.Init.CLKPolarity;
+			cfg->hspi->Init.CLKPhase		  = hspi1.Init.CLKPhase;
+			cfg->hspi->Init.BaudRatePrescaler = hspi1.Init.BaudRatePrescaler;
+			HAL_SPI_Init(cfg->hspi);
+		}
+
+		LTC6804_initialize(&bus_ltc[bus], cfg->hspi, cfg->cs_port, cfg->cs_pin);
+		ltc_dma_init(&bus_dma[bus], cfg->hspi, cfg->cs_port, cfg->cs_pin, cfg->num_chips);
 
-	pull_chip_configuration();
+		bus_first_chip[bus] = first_chip;
+		bus_chips[bus]		= (UINT32_MAX >> (32 - cfg->num_chips)) << first_chip;
+		for (uint8_t chip = 0; chip < cfg->num_chips; chip++) {
+			mapping_correction[first_chip + chip] = cfg->mapping[chip];
+		}
+		first_chip += cfg->num_chips;
+	}
 
+	/*
+	 * REFON keeps the reference up between conversions. Otherwise every conversion first waits out
+	 * tREFUP, which the conversion deadlines don't cover
+	 */
 	for (int c = 0; c < NUM_CHIPS; c++) {
-		local_config[c][0] = 0xF8;
+		local_config[c][0] = 0xFC;
 		local_config[c][1] = 0x19; /* VUV = 0x619 = 1561 -> 2.4992V */
 		local_config[c][2] = 0x06; /* VOV = 0xA60 = 2656 -> 4.2496V */
 		local_config[c][3] = 0xA6;
 		local_config[c][4] = 0x00;
 		local_config[c][5] = 0x00;
 	}
-	push_chip_configuration();
 
-	start_timer(&voltage_reading_timer, VOLTAGE_WAIT_TIME);
-	start_timer(&therm_timer, THERM_WAIT_TIME);
+	/* Whatever is on the chips right now is unknown */
+	config_dirty = ALL_CHIPS;
+	push_chip_configuration();
+	start_timer(&config_verify_timer, CONFIG_VERIFY_TIME);
 
 	uint8_t i2c_write_data[NUM_CHIPS][3];
 
@@ -90,8 +260,15 @@ void segment_init()
   uint8_t comm_reg_data[NUM_CHIPS][6];
 
   serialize_i2c_msg(i2c_write_data, comm_reg_data);
-  LTC6804_wrcomm(ltc68041, NUM_CHIPS, comm_reg_data);
-  LTC6804_stcomm(ltc68041, 24);
+  write_comm(comm_reg_data);
+}
+
+void write_comm(uint8_t comm_reg_data[][6])
+{
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		LTC6804_wrcomm(&bus_ltc[bus], bus_table[bus].num_chips, &comm_reg_data[bus_first_chip[bus]]);
+		LTC6804_stcomm(&bus_ltc[bus], 24);
+	}
 }
 
 void select_therm(uint8_t therm){
@@ -110,52 +287,340 @@ void select_therm(uint8_t therm){
     	i2c_write_data[chip][2] = (therm - 1); // 0-15, will change multiplexer to select thermistor
     }
     serialize_i2c_msg(i2c_write_data, comm_reg_data);
-	push_chip_configuration();
-	LTC6804_wrcomm(ltc68041, NUM_CHIPS, comm_reg_data);
-	LTC6804_stcomm(ltc68041, 24);
+	write_comm(comm_reg_data);
 }
 
-int pull_voltages()
+void decode_group(uint8_t bus, const ltc_dma_frame_t* frame, uint8_t cmd, uint8_t group)
 {
-	/**
-	 * If we haven't waited long enough between pulling voltage data
-	 * just copy over the contents of the last good reading and the fault status
-	 * from the most recent attempt
-	 */
+	uint32_t pec_failures;
+	pec15_verify_chain(ltc_dma_chip_data(frame, cmd, 0), bus_table[bus].num_chips, &pec_failures);
 
-	//int test_v[12] = {800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800, 800};
-	if (!is_timer_expired(&voltage_reading_timer) && voltage_reading_timer.active) {
-		for (uint8_t i = 0; i < NUM_CHIPS; i++) {
-			memcpy(segment_data[i].voltage, previous_data[i].voltage,
-				sizeof(segment_data[i].voltage));
+	for (uint8_t bus_chip = 0; bus_chip < bus_table[bus].num_chips; bus_chip++) {
+		uint8_t chip = bus_first_chip[bus] + bus_chip;
+
+		/* Only chips still missing this group need to be filled in */
+		if (!(group_failures[group] & (1u << chip)))
+			continue;
+
+		if (pec_failures & (1u << bus_chip)) {
+			link_stats[mapping_correction[chip]].pec_errors++;
+			continue;
+		}
+
+		/* Each group holds 3 codes, LSB first */
+		const uint8_t* data = ltc_dma_chip_data(frame, cmd, bus_chip);
+		for (uint8_t code = 0; code < 3; code++) {
+			raw_codes[chip][group * 3 + code] = data[2 * code] | (data[2 * code + 1] << 8);
 		}
-		return voltage_error;
+		group_failures[group] &= ~(1u << chip);
+	}
+}
+
+int start_group_read(uint8_t bus, uint8_t groups)
+{
+	uint16_t cmds[NUM_READ_GROUPS];
+	uint8_t num_cmds = 0;
+
+	for (uint8_t group = 0; group < NUM_READ_GROUPS; group++) {
+		if (!(groups & (1 << group)))
+			continue;
+
+		read_groups[bus][num_cmds] = group;
+		cmds[num_cmds++]		   = read_cmds[group];
 	}
+	num_read_groups[bus] = num_cmds;
 
-	uint16_t raw_voltages[NUM_CHIPS][12];
+	return ltc_dma_read(&bus_dma[bus], cmds, num_cmds);
+}
+
+bool buses_busy()
+{
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		if (ltc_dma_busy(&bus_dma[bus]))
+			return true;
+	}
+
+	return false;
+}
+
+void wait_buses()
+{
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		ltc_dma_wait(&bus_dma[bus]);
+	}
+}
+
+void record_acq_frame(segment_acq_mode_t mode, uint32_t bytes, uint32_t cycles)
+{
+	acq_stats[mode].bytes	   = bytes;
+	acq_stats[mode].latency_us = cycles / (SystemCoreClock / 1000000);
+	acq_stats[mode].frames++;
+}
+
+bool conversion_elapsed(uint32_t start_cycle, uint32_t time_us)
+{
+	return DWT->CYCCNT - start_cycle >= (time_us + CONV_TIME_MARGIN) * (SystemCoreClock / 1000000);
+}
+
+uint32_t ref_startup_time(uint32_t start_cycle)
+{
+	/*
+	 * A config write is where a chip that reset (ex. its watchdog ran out) gets REFON back, so a
+	 * conversion started within tREFUP of one may still be waiting on its reference
+	 */
+	if (start_cycle - config_write_cycle < REF_STARTUP_TIME * (SystemCoreClock / 1000000))
+		return REF_STARTUP_TIME;
+
+	return 0;
+}
+
+void segment_set_adc_mode(uint8_t md, uint8_t dcp)
+{
+	if (md > MD_FILTERED)
+		return;
+
+	/* Conversions already in flight keep the deadline they were started with */
+	adc_md	= md;
+	adc_dcp = dcp;
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		set_adc(&bus_ltc[bus], md, dcp, CELL_CH_ALL, AUX_CH_ALL);
+	}
+}
+
+uint32_t segment_get_conversion_time(uint8_t md)
+{
+	if (md > MD_FILTERED)
+		return 0;
+
+	return acq_mode == SEGMENT_ACQ_COMBINED ? ADCVAX_CONV_TIME[md] : ADCV_CONV_TIME[md];
+}
+
+const link_stats_t* segment_get_link_stats(uint8_t chip)
+{
+	return &link_stats[chip];
+}
+
+void segment_set_acq_mode(segment_acq_mode_t mode)
+{
+	if (mode < SEGMENT_ACQ_NUM_MODES)
+		acq_mode = mode;
+}
+
+const segment_acq_stats_t* segment_get_acq_stats(segment_acq_mode_t mode)
+{
+	return &acq_stats[mode];
+}
+
+uint16_t segment_get_voltage_generation()
+{
+	return voltage_generation;
+}
+
+uint16_t segment_get_therm_generation()
+{
+	return therm_generation;
+}
+
+bool segment_start_conversion()
+{
+	if (voltage_state != VOLTAGE_IDLE || buses_busy())
+		return false;
+
+	/* Wait out the sample period */
+	if (voltage_reading_timer.active && !is_timer_expired(&voltage_reading_timer))
+		return false;
+
+	/* Don't stomp on an aux conversion the thermistor scan is waiting on */
+	if (therm_scan_state == THERM_CONVERT)
+		return false;
 
 	push_chip_configuration();
-	LTC6804_adcv(ltc68041);
+
+	/*
+	 * In combined mode, pick up the thermistors with the cells once the mux output has settled.
+	 * The ref channel still goes through ADAX since ADCVAX doesn't convert GPIO3
+	 */
+	conversion_has_aux = acq_mode == SEGMENT_ACQ_COMBINED && therm_scan_state == THERM_SETTLE
+		&& current_therm != REF_REFRESH_THERM && is_timer_expired(&therm_timer);
+
+	/*
+	 * The deadline is taken from when the command went out on the last bus, the readback
+	 * can't start before it
+	 */
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		if (!conversion_has_aux) {
+			LTC6804_adcv(&bus_ltc[bus]);
+			continue;
+		}
+
+		/*
+		 * Reading back after a command that never went out would pass the old registers off as
+		 * a new conversion. Stay idle and try again on the next loop
+		 */
+		if (ltc_dma_send_command(&bus_dma[bus], LTC_CMD_ADCVAX(adc_md, adc_dcp)) != 0)
+			return false;
+	}
+	conversion_start_cycle = DWT->CYCCNT;
+	conversion_time		   = conversion_has_aux ? ADCVAX_CONV_TIME[adc_md] : ADCV_CONV_TIME[adc_md];
+	conversion_time += ref_startup_time(conversion_start_cycle);
+	start_timer(&voltage_reading_timer, VOLTAGE_WAIT_TIME);
+	voltage_state = VOLTAGE_CONVERTING;
+
+	return true;
+}
+
+int pull_voltages()
+{
+	int res = voltage_error;
+
+	/* Conversion is done, stream the cell codes back in the background */
+	if (voltage_state == VOLTAGE_CONVERTING && conversion_elapsed(conversion_start_cycle, conversion_time)) {
+		uint8_t groups = conversion_has_aux ? ALL_GROUPS_WITH_AUX : ALL_CELL_GROUPS;
+
+		/* Every chip starts out missing every group, decoding clears them as they pass PEC */
+		for (uint8_t group = 0; group < NUM_READ_GROUPS; group++) {
+			group_failures[group] = (groups & (1 << group)) ? ALL_CHIPS : 0;
+		}
+		group_retries = 0;
+		read_bytes	  = NUM_SPI_BUSES * LTC_DMA_CMD_LEN; /* the conversion commands */
+
+		/* A bus that fails to start keeps its groups marked as failed for the retries to pick up */
+		for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+			start_group_read(bus, groups);
+		}
+		voltage_state = VOLTAGE_READING;
+	}
 
 	/**
-	 * If we received an incorrect PEC indicating a bad read
-	 * copy over the data from the last good read and indicate an error
+	 * If a new reading hasn't come in yet, just copy over the contents of the last good
+	 * reading and the fault status from the most recent attempt
 	 */
-	if (LTC6804_rdcv(ltc68041, 0, NUM_CHIPS, raw_voltages) == -1) {
+	if (voltage_state != VOLTAGE_READING || buses_busy()) {
 		for (uint8_t i = 0; i < NUM_CHIPS; i++) {
 			memcpy(segment_data[i].voltage, previous_data[i].voltage,
 				sizeof(segment_data[i].voltage));
+			segment_data[i].voltage_stale_age = previous_data[i].voltage_stale_age;
+			segment_data[i].stale_groups	  = previous_data[i].stale_groups;
+		}
+		return res;
+	}
+
+	/* Every bus has finished, merge their frames. One that errored out leaves its groups marked as failed */
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		const ltc_dma_frame_t* frame = ltc_dma_get_frame(&bus_dma[bus]);
+		if (frame == NULL)
+			continue;
+
+		read_bytes += ltc_dma_get_stats(&bus_dma[bus])->bytes;
+		for (uint8_t cmd = 0; cmd < num_read_groups[bus]; cmd++) {
+			decode_group(bus, frame, cmd, read_groups[bus][cmd]);
+		}
+	}
+
+	/* Re-read just the groups that failed PEC, the registers hold until the next conversion */
+	uint8_t failed_groups = 0;
+	for (uint8_t group = 0; group < NUM_READ_GROUPS; group++) {
+		if (group_failures[group])
+			failed_groups |= 1 << group;
+	}
+
+	if (failed_groups && group_retries < MAX_GROUP_RETRIES) {
+		group_retries++;
+		for (uint8_t group = 0; group < NUM_READ_GROUPS; group++) {
+			for (uint8_t chip = 0; chip < NUM_CHIPS; chip++) {
+				if (group_failures[group] & (1u << chip))
+					link_stats[mapping_correction[chip]].retries++;
+			}
+		}
+
+		/* Only the buses with failing chips go back out */
+		bool retrying = false;
+		for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+			uint8_t bus_failed_groups = 0;
+			for (uint8_t group = 0; group < NUM_READ_GROUPS; group++) {
+				if (group_failures[group] & bus_chips[bus])
+					bus_failed_groups |= 1 << group;
+			}
 
-			printf("Bad voltage read\n");
+			if (bus_failed_groups && start_group_read(bus, bus_failed_groups) == 0)
+				retrying = true;
 		}
-		return 1;
+
+		if (retrying) {
+			for (uint8_t i = 0; i < NUM_CHIPS; i++) {
+				memcpy(segment_data[i].voltage, previous_data[i].voltage,
+					sizeof(segment_data[i].voltage));
+				segment_data[i].voltage_stale_age = previous_data[i].voltage_stale_age;
+				segment_data[i].stale_groups	  = previous_data[i].stale_groups;
+			}
+			return res;
+		}
+	}
+
+	voltage_state = VOLTAGE_IDLE;
+
+	/* Anything still failing after the retries is filled in from the last good read */
+	if (failed_groups & ALL_CELL_GROUPS) {
+		printf("Bad voltage read\n");
+		res = 1;
+	} else {
+		res = 0;
+	}
+
+	process_voltages();
+	voltage_generation++;
+
+	uint32_t cycles = DWT->CYCCNT - conversion_start_cycle;
+
+	if (conversion_has_aux) {
+		for (uint8_t chip = 0; chip < NUM_CHIPS; chip++) {
+			for (uint8_t gpio = 0; gpio < 3; gpio++) {
+				combined_aux[chip][gpio] = (group_failures[AUX_GROUP] & (1u << chip))
+					? LTC_BAD_READ
+					: raw_codes[chip][AUX_GROUP * 3 + gpio];
+			}
+		}
+		combined_aux_ready = true;
+		record_acq_frame(SEGMENT_ACQ_COMBINED, read_bytes, cycles);
+	} else {
+		/* Separate frames are completed by the thermistor scan */
+		voltage_frame_bytes	 = read_bytes;
+		voltage_frame_cycles = cycles;
 	}
 
+	return res;
+}
+
+void process_voltages()
+{
 	/* If the read was successful, copy the voltage data */
 	for (uint8_t i = 0; i < NUM_CHIPS; i++) {
 
 		int corrected_index = mapping_correction[i];
 
+		/* Groups that never made it through PEC keep their cells from the last good read */
+		uint8_t stale_groups = 0;
+		for (uint8_t group = 0; group < NUM_RDCV_GROUPS; group++) {
+			if (group_failures[group] & (1u << i))
+				stale_groups |= 1 << group;
+		}
+
+		segment_data[corrected_index].stale_groups = stale_groups;
+		if (!stale_groups)
+			segment_data[corrected_index].voltage_stale_age = 0;
+		else if (previous_data[corrected_index].voltage_stale_age < UINT8_MAX)
+			segment_data[corrected_index].voltage_stale_age = previous_data[corrected_index].voltage_stale_age + 1;
+		else
+			segment_data[corrected_index].voltage_stale_age = UINT8_MAX;
+
+		link_stats_t* link = &link_stats[corrected_index];
+		if (!stale_groups) {
+			link->consecutive_failures = 0;
+			link->last_good			   = HAL_GetTick();
+		} else if (link->consecutive_failures < UINT8_MAX) {
+			link->consecutive_failures++;
+		}
+
 		/* correction to account for missing index, see more info below */
 		int dest_index = 0;
 
@@ -164,28 +629,37 @@ int pull_voltages()
 			/* cell 6 on every chip is not a real reading, we need to have the array skip this, and shift the remaining readings up one index*/
 			if (j == 5) continue;
 
+			if (stale_groups & (1 << (j / 3))) {
+				segment_data[corrected_index].voltage[dest_index] = previous_data[corrected_index].voltage[dest_index];
+				segment_data[corrected_index].noise_reading[dest_index] = previous_data[corrected_index].noise_reading[dest_index];
+				segment_data[corrected_index].consecutive_noise[dest_index] = previous_data[corrected_index].consecutive_noise[dest_index];
+				dest_index++;
+				continue;
+			}
+
 			segment_data[corrected_index].noise_reading[dest_index] = 0;
 
-			if (raw_voltages[i][j] > (int)(10000 * (MAX_VOLT + 0.5)) || raw_voltages[i][j] < (int)(10000 * (MIN_VOLT - 0.5))) {
+			if (raw_codes[i][j] > (int)(10000 * (MAX_VOLT + 0.5)) || raw_codes[i][j] < (int)(10000 * (MIN_VOLT - 0.5))) {
 				//if (previous_data[corrected_index].voltage[dest_index] > 45000 || previous_data[corrected_index].voltage[dest_index] < 20000) printf("poop\r\n");
 				segment_data[corrected_index].voltage[dest_index] = previous_data[corrected_index].voltage[dest_index];
 				segment_data[corrected_index].noise_reading[dest_index] = 1;
 				segment_data[corrected_index].consecutive_noise[dest_index]++;
+				link->substituted_cells++;
 				//printf("New data: %d\r\n", segment_data[corrected_index].voltage[dest_index]);
 				// if (segment_data[corrected_index].consecutive_noise[dest_index] > MAX_CONSEC_NOISE) {
 				// 	segment_data[corrected_index].noise_reading[dest_index] = 0;
 				// 	segment_data[corrected_index].consecutive_noise[dest_index] = 0;
-				// 	segment_data[corrected_index].voltage[dest_index] = raw_voltages[i][j];
+				// 	segment_data[corrected_index].voltage[dest_index] = raw_codes[i][j];
 				// }
 			} else {
 				//printf("previous: %d\r\n", previous_data[corrected_index].voltage[dest_index]);
 				//if (previous_data[corrected_index].voltage[dest_index] > 45000 || previous_data[corrected_index].voltage[dest_index] < 20000) printf("pee\r\n");
 				//else printf("wiping\r\n");
 				segment_data[corrected_index].consecutive_noise[dest_index] = 0;
-				segment_data[corrected_index].voltage[dest_index] = raw_voltages[i][j];
+				segment_data[corrected_index].voltage[dest_index] = raw_codes[i][j];
 
-				if (raw_voltages[i][j] < 45000 && raw_voltages[i][j] > 24000) {
-					previous_data[corrected_index].voltage[dest_index] = raw_voltages[i][j];
+				if (raw_codes[i][j] < 45000 && raw_codes[i][j] > 24000) {
+					previous_data[corrected_index].voltage[dest_index] = raw_codes[i][j];
 					//printf("previous: %d\r\n", previous_data[corrected_index].voltage[dest_index]);	
 					//printf("raw: %d\r\n", segment_data[corrected_index].voltage[dest_index]);
 					}
@@ -194,91 +668,81 @@ int pull_voltages()
 			dest_index++;
 		}
 	}
-
-	
-	/* Start the timer between readings if successful */
-	start_timer(&voltage_reading_timer, VOLTAGE_WAIT_TIME);
-
-	return 0;
 }
 
 int pull_thermistors()
 {
-	/* If polled too soon, just copy existing values from memory */
-	if (!is_timer_expired(&therm_timer)) {
-		for (uint8_t i = 0; i < NUM_CHIPS; i++) {
-			memcpy(segment_data[i].thermistor_reading, previous_data[i].thermistor_reading,
-				sizeof(segment_data[i].thermistor_reading));
-			memcpy(segment_data[i].thermistor_value, previous_data[i].thermistor_value,
-				sizeof(segment_data[i].thermistor_value));
-		}
-		return voltage_error;
+	/*
+	 * Every channel except the one that finishes converting this call is carried over from the
+	 * last reading
+	 */
+	for (uint8_t i = 0; i < NUM_CHIPS; i++) {
+		memcpy(segment_data[i].thermistor_reading, previous_data[i].thermistor_reading,
+			sizeof(segment_data[i].thermistor_reading));
+		memcpy(segment_data[i].thermistor_value, previous_data[i].thermistor_value,
+			sizeof(segment_data[i].thermistor_value));
+		segment_data[i].therm_stale_age = previous_data[i].therm_stale_age;
 	}
 
-	uint16_t raw_temp_voltages[NUM_CHIPS][6];
-
-	static uint8_t current_therm = 1;
-	if (current_therm > 16) {
-		current_therm = 1;
+	/* A combined conversion already brought this channel in alongside the cell voltages */
+	if (combined_aux_ready) {
+		combined_aux_ready = false;
+		process_thermistors(combined_aux);
+		advance_therm_scan();
+		return 0;
 	}
 
-	/* Sets multiplexors to select thermistors */
-	select_therm(current_therm);
-	HAL_Delay(200);
-	//push_chip_configuration();
-	LTC6804_clraux(ltc68041);
-	LTC6804_adax(ltc68041);	/* Run ADC for AUX (GPIOs and refs) */
-	HAL_Delay(3);	
-	LTC6804_rdaux(ltc68041, 0, NUM_CHIPS, raw_temp_voltages);
-	/* Rotate through all thermistor pairs (we can poll two at once) */
-	for (uint8_t therm = 1; therm <= (NUM_THERMS_PER_CHIP / 2); therm++) {
-		for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+	/* Let a voltage acquisition finish before touching the bus or starting another conversion */
+	if (voltage_state != VOLTAGE_IDLE)
+		return therm_error;
 
-			int corrected_index = mapping_correction[c];
-			/*
-			 * Get current temperature LUT. Voltage is adjusted to account for 5V reg
-			 * fluctuations (index 2 is a reading of the ADC 5V ref)
-			 */
-			if (therm == current_therm) {
-				/* see "thermister decoding" in confluence in shepherd software 22A */
-				uint16_t steinhart_input_low = 10000 * (float)( ((float)raw_temp_voltages[c][2])/ (raw_temp_voltages[c][0]) - 1 );
-				uint16_t steinhart_input_high = 10000 * (float)( ((float)raw_temp_voltages[c][2])/ (raw_temp_voltages[c][1]) - 1 );
-
-				segment_data[corrected_index].thermistor_reading[therm - 1] = steinhart_est(steinhart_input_low);
-				segment_data[corrected_index].thermistor_reading[therm + 15] = steinhart_est(steinhart_input_high);
-
-				/* Directly update for a set time from start up due to therm voltages
-			 	* needing to settle */
-				segment_data[corrected_index].thermistor_value[therm - 1]
-					= segment_data[corrected_index].thermistor_reading[therm - 1];
-				segment_data[corrected_index].thermistor_value[therm + 15]
-					= segment_data[corrected_index].thermistor_reading[therm + 15];
-
-				if (raw_temp_voltages[c][0] == LTC_BAD_READ
-					|| raw_temp_voltages[c][1] == LTC_BAD_READ
-					|| segment_data[corrected_index].thermistor_value[therm - 1] > (MAX_CELL_TEMP + 5)
-					|| segment_data[corrected_index].thermistor_value[therm + 15] > (MAX_CELL_TEMP + 5 )
-					|| segment_data[corrected_index].thermistor_value[therm - 1] < (MIN_CELL_TEMP - 5)
-					|| segment_data[corrected_index].thermistor_value[therm + 15] < (MIN_CELL_TEMP - 5 )) {
-					memcpy(segment_data[corrected_index].thermistor_reading, previous_data[c].thermistor_reading,
-						sizeof(segment_data[corrected_index].thermistor_reading));
-					memcpy(segment_data[corrected_index].thermistor_value, previous_data[c].thermistor_value,
-						sizeof(segment_data[corrected_index].thermistor_value));
-				}
-			}
-			else {
-				segment_data[corrected_index].thermistor_reading[therm - 1] = previous_data[corrected_index].thermistor_reading[therm - 1];
-				segment_data[corrected_index].thermistor_reading[therm + 15] = previous_data[corrected_index].thermistor_reading[therm + 15];
-
-				segment_data[corrected_index].thermistor_value[therm - 1]
-					= segment_data[corrected_index].thermistor_reading[therm - 1];
-				segment_data[corrected_index].thermistor_value[therm + 15]
-					= segment_data[corrected_index].thermistor_reading[therm + 15];
-			}
+	/*
+	 * Resumable scan, each call only advances the pipeline if its wait is over so the
+	 * loop never blocks on the mux settling or the ADAX conversion
+	 */
+	switch (therm_scan_state) {
+	case THERM_SELECT:
+		/* Sets multiplexors to select thermistors */
+		select_therm(current_therm);
+		start_timer(&therm_timer, THERM_SETTLE_TIME);
+		therm_scan_state = THERM_SETTLE;
+		return therm_error;
+
+	case THERM_SETTLE:
+		if (!is_timer_expired(&therm_timer))
+			return therm_error;
+
+		/* The next cell conversion will pick this channel up */
+		if (acq_mode == SEGMENT_ACQ_COMBINED && current_therm != REF_REFRESH_THERM)
+			return therm_error;
+
+		for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+			LTC6804_clraux(&bus_ltc[bus]);
+			LTC6804_adax(&bus_ltc[bus]); /* Run ADC for AUX (GPIOs and refs) */
 		}
+		therm_conversion_start_cycle = DWT->CYCCNT;
+		therm_conversion_time		 = ADAX_CONV_TIME[adc_md] + ref_startup_time(therm_conversion_start_cycle);
+		therm_scan_state = THERM_CONVERT;
+		return therm_error;
+
+	case THERM_CONVERT:
+		if (!conversion_elapsed(therm_conversion_start_cycle, therm_conversion_time))
+			return therm_error;
+		break;
 	}
-	current_therm++;
-	start_timer(&therm_timer, 100/*THERM_WAIT_TIME*/); /* Start timer for next reading */
+
+	uint16_t raw_temp_voltages[NUM_CHIPS][6];
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		LTC6804_rdaux(&bus_ltc[bus], 0, bus_table[bus].num_chips, &raw_temp_voltages[bus_first_chip[bus]]);
+	}
+
+	/* CLRAUX and ADAX commands plus both aux group readbacks on every bus */
+	uint32_t therm_bytes = NUM_SPI_BUSES * 4 * LTC_DMA_CMD_LEN + 2 * NUM_CHIPS * LTC_DMA_BYTES_PER_IC;
+	record_acq_frame(SEGMENT_ACQ_SEPARATE, voltage_frame_bytes + therm_bytes,
+		voltage_frame_cycles + (DWT->CYCCNT - therm_conversion_start_cycle));
+
+	process_thermistors(raw_temp_voltages);
+	advance_therm_scan();
 
 	/* the following algorithms were used to eliminate noise on Car 17D - keep them off if possible */
 	//variance_therm_check();
@@ -289,7 +753,71 @@ int pull_thermistors()
 	return 0; /* Read successfully */
 }
 
+void process_thermistors(uint16_t raw_temp_voltages[NUM_CHIPS][6])
+{
+	/* We poll two thermistors at once, current_therm on the low and high mux */
+	const uint8_t therm = current_therm;
+	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+
+		int corrected_index = mapping_correction[c];
+
+		if (raw_temp_voltages[c][0] == LTC_BAD_READ || raw_temp_voltages[c][1] == LTC_BAD_READ)
+			link_stats[corrected_index].bad_reads++;
+
+		/*
+		 * Get current temperature LUT. Voltage is adjusted to account for 5V reg
+		 * fluctuations (index 2 is a reading of the ADC 5V ref)
+		 */
+		int16_t temp_low = therm_decidegrees(raw_temp_voltages[c][0], raw_temp_voltages[c][2]);
+		int16_t temp_high = therm_decidegrees(raw_temp_voltages[c][1], raw_temp_voltages[c][2]);
+
+		segment_data[corrected_index].thermistor_reading[therm - 1] = round_decidegrees(temp_low);
+		segment_data[corrected_index].thermistor_reading[therm + 15] = round_decidegrees(temp_high);
+
+		/* Directly update for a set time from start up due to therm voltages
+		 * needing to settle */
+		segment_data[corrected_index].thermistor_value[therm - 1]
+			= segment_data[corrected_index].thermistor_reading[therm - 1];
+		segment_data[corrected_index].thermistor_value[therm + 15]
+			= segment_data[corrected_index].thermistor_reading[therm + 15];
+
+		if (raw_temp_voltages[c][0] == LTC_BAD_READ
+			|| raw_temp_voltages[c][1] == LTC_BAD_READ
+			|| segment_data[corrected_index].thermistor_value[therm - 1] > (MAX_CELL_TEMP + 5)
+			|| segment_data[corrected_index].thermistor_value[therm + 15] > (MAX_CELL_TEMP + 5 )
+			|| segment_data[corrected_index].thermistor_value[therm - 1] < (MIN_CELL_TEMP - 5)
+			|| segment_data[corrected_index].thermistor_value[therm + 15] < (MIN_CELL_TEMP - 5 )) {
+			memcpy(segment_data[corrected_index].thermistor_reading, previous_data[corrected_index].thermistor_reading,
+				sizeof(segment_data[corrected_index].thermistor_reading));
+			memcpy(segment_data[corrected_index].thermistor_value, previous_data[corrected_index].thermistor_value,
+				sizeof(segment_data[corrected_index].thermistor_value));
+
+			if (segment_data[corrected_index].therm_stale_age < UINT8_MAX)
+				segment_data[corrected_index].therm_stale_age++;
+		} else {
+			segment_data[corrected_index].therm_stale_age = 0;
+		}
+	}
+
+	therm_generation++;
+}
+
+void advance_therm_scan()
+{
+	/* Select the next channel right away so its settle time overlaps with the rest of the loop */
+	current_therm = (current_therm % (NUM_THERMS_PER_CHIP / 2)) + 1;
+	select_therm(current_therm);
+	start_timer(&therm_timer, THERM_SETTLE_TIME);
+	therm_scan_state = THERM_SETTLE;
+}
+
 void segment_retrieve_data(chipdata_t databuf[NUM_CHIPS])
+{
+	segment_start_conversion();
+	segment_collect(databuf);
+}
+
+void segment_collect(chipdata_t databuf[NUM_CHIPS])
 {
 	segment_data = databuf;
 
@@ -298,6 +826,13 @@ void segment_retrieve_data(chipdata_t databuf[NUM_CHIPS])
 	voltage_error = pull_voltages();
 	therm_error = pull_thermistors();
 
+	/* Background check that the chips still hold the config we wrote, only between acquisitions */
+	if (is_timer_expired(&config_verify_timer) && voltage_state == VOLTAGE_IDLE
+		&& therm_scan_state != THERM_CONVERT) {
+		verify_chip_configuration();
+		start_timer(&config_verify_timer, CONFIG_VERIFY_TIME);
+	}
+
 	/* Save the contents of the reading so that we can use it to fill in missing
 	 * data */
 	memcpy(previous_data, segment_data, sizeof(chipdata_t) * NUM_CHIPS);
@@ -346,8 +881,6 @@ void segment_enable_balancing(bool balance_enable)
 // @todo Revisit after testing
 void cell_enable_balancing(uint8_t chip_num, uint8_t cell_num, bool balance_enable)
 {
-	pull_chip_configuration();
-
 	if (balance_enable)
 		discharge_commands[chip_num] |= (1 << cell_num);
 	else
@@ -406,45 +939,47 @@ bool segment_is_balancing()
 	return false;
 }
 
-void pull_chip_configuration()
+void verify_chip_configuration()
 {
 	uint8_t remote_config[NUM_CHIPS][8];
-	LTC6804_rdcfg(ltc68041, NUM_CHIPS, remote_config);
+	wait_buses();
 
-	for (int chip = 0; chip < NUM_CHIPS; chip++) {
-		for (int index = 0; index < 6; index++) {
-			local_config[chip][index] = remote_config[chip][index];
-		}
-	}
-}
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		uint8_t first_chip = bus_first_chip[bus];
 
-int8_t steinhart_est(uint16_t V)
-{
-	/* min temp - max temp with buffer on both */
-	for (int i = -25; i < 80; i++) {
-		if (V > VOLT_TEMP_CONV[i + 25]) {
-			return i;
+		/* Try this bus again next time around if the readback itself is bad */
+		if (LTC6804_rdcfg(&bus_ltc[bus], bus_table[bus].num_chips, &remote_config[first_chip]) == -1)
+			continue;
+
+		/* A chip that reset or missed a write gets rewritten */
+		for (uint8_t chip = first_chip; chip < first_chip + bus_table[bus].num_chips; chip++) {
+			if (((remote_config[chip][0] ^ written_config[chip][0]) & CFGR0_READBACK_MASK)
+				|| memcmp(&remote_config[chip][1], &written_config[chip][1], 5))
+				config_dirty |= 1u << chip;
 		}
 	}
 
-	return 80;
-	
+	push_chip_configuration();
 }
+
 void disable_gpio_pulldowns()
 {
 	HAL_Delay(1000);
 	/* Turn OFF GPIO 1 & 2 pull downs */
-	pull_chip_configuration();
 	for (int c = 0; c < NUM_CHIPS; c++) {
 		local_config[c][0] |= 0x18;
 	}
 	push_chip_configuration();
 
-	pull_chip_configuration();
+	uint8_t remote_config[NUM_CHIPS][8];
+	wait_buses();
+	for (uint8_t bus = 0; bus < NUM_SPI_BUSES; bus++) {
+		LTC6804_rdcfg(&bus_ltc[bus], bus_table[bus].num_chips, &remote_config[bus_first_chip[bus]]);
+	}
 	printf("Chip CFG:\n");
 	for (int c = 0; c < NUM_CHIPS; c++) {
 		for (int byte = 0; byte < 6; byte++) {
-			printf("%x", local_config[c][byte]);
+			printf("%x", remote_config[c][byte]);
 			printf("\t");
 		}
 		printf("\n");
@@ -0,0 +1,168 @@
+#include "soc_ekf.h"
+#include "bmsConfig.h"
+#include "lut_tables.h"
+#include <math.h>
+
+/*
+ * The cell is its OCV curve in series with R0 and one RC pair, so under a discharge current I
+ *
+ *     V = OCV(soc) - R0 * I - v_rc        dv_rc/dt = (R1 * I - v_rc) / RC_TAU
+ *
+ * The state is (soc, v_rc). Predictions come from the coulomb counter's charge, corrections
+ * from the measured cell voltage, which ties the estimate back to the OCV curve under load
+ * instead of only once the pack has rested. All of it is single precision on the FPU.
+ */
+
+/* Model parameters, may need adjustment once fitted to logged discharges */
+#define RC_TAU	   30.0f /* s */
+#define RC_R_RATIO 1.0f	 /* R1 relative to R0, the two move together with temperature */
+
+/* Noise, one standard deviation each */
+#define CURRENT_NOISE  0.5f	  /* A of current sensor error the coulomb count inherits */
+#define SOC_NOISE	   1e-4f  /* per root second, capacity error and anything else not counted */
+#define RC_NOISE	   0.01f  /* V per root second, large so model error lands on v_rc and not soc */
+#define VOLTAGE_NOISE  0.020f /* V, cell voltage measurement plus OCV curve error */
+#define INIT_SOC_NOISE 0.05f  /* error of the OCV lookup the filter starts from */
+#define INIT_RC_NOISE  0.01f  /* V */
+
+#define CAPACITY ((float)PACK_CAPACITY * 3600.0f) /* As */
+
+static float clamp_soc(float soc)
+{
+	if (soc < 0.0f)
+		return 0.0f;
+	if (soc > 1.0f)
+		return 1.0f;
+	return soc;
+}
+
+/**
+ * @brief Returns the OCV at soc in V, and the slope of the curve there in V per unit of SOC
+ */
+static float ocv(float soc, float* slope)
+{
+	/* OCV_LUT spans SOC 0 to 1 evenly, len - 1 entries per unit */
+	float pos = clamp_soc(soc) * (OCV_LUT.len - 1);
+	uint16_t i = pos;
+	if (i > OCV_LUT.len - 2)
+		i = OCV_LUT.len - 2;
+
+	float step = (OCV_LUT.y[i + 1] - OCV_LUT.y[i]) / 1000.0f;
+	*slope	   = step * (OCV_LUT.len - 1);
+
+	return OCV_LUT.y[i] / 1000.0f + step * (pos - i);
+}
+
+void soc_ekf_init(soc_ekf_t* ekf, float soc)
+{
+	ekf->soc	 = clamp_soc(soc);
+	ekf->v_rc	 = 0.0f;
+	ekf->p_soc	 = INIT_SOC_NOISE * INIT_SOC_NOISE;
+	ekf->p_cross = 0.0f;
+	ekf->p_rc	 = INIT_RC_NOISE * INIT_RC_NOISE;
+}
+
+void soc_ekf_predict(soc_ekf_t* ekf, float charge, float dt, float r0)
+{
+	/* Backward Euler step of the RC pair, driven by the average current over dt */
+	float decay	  = RC_TAU / (RC_TAU + dt);
+	float current = dt > 0.0f ? charge / dt : 0.0f;
+
+	ekf->soc  = clamp_soc(ekf->soc - charge / CAPACITY);
+	ekf->v_rc = decay * ekf->v_rc + (1.0f - decay) * RC_R_RATIO * r0 * current;
+
+	/* P = F P F' + Q with F = diag(1, decay) */
+	float soc_noise = CURRENT_NOISE * dt / CAPACITY;
+	ekf->p_soc += soc_noise * soc_noise + SOC_NOISE * SOC_NOISE * dt;
+	ekf->p_cross *= decay;
+	ekf->p_rc = decay * decay * ekf->p_rc + RC_NOISE * RC_NOISE * dt;
+}
+
+void soc_ekf_correct(soc_ekf_t* ekf, float voltage, float current, float r0)
+{
+	float slope;
+	float residual = voltage - (ocv(ekf->soc, &slope) - r0 * current - ekf->v_rc);
+
+	/* H = (slope, -1), so P H' and the innovation variance H P H' + R are */
+	float ph_soc	 = ekf->p_soc * slope - ekf->p_cross;
+	float ph_rc		 = ekf->p_cross * slope - ekf->p_rc;
+	float innovation = slope * ph_soc - ph_rc + VOLTAGE_NOISE * VOLTAGE_NOISE;
+
+	float gain_soc = ph_soc / innovation;
+	float gain_rc  = ph_rc / innovation;
+
+	ekf->soc = clamp_soc(ekf->soc + gain_soc * residual);
+	ekf->v_rc += gain_rc * residual;
+
+	/* P -= K H P, which is K (P H')' and keeps P symmetric */
+	ekf->p_soc -= gain_soc * ph_soc;
+	ekf->p_cross -= gain_soc * ph_rc;
+	ekf->p_rc -= gain_rc * ph_rc;
+
+	/* Rounding can't be allowed to take a variance negative */
+	if (ekf->p_soc < 1e-9f)
+		ekf->p_soc = 1e-9f;
+	if (ekf->p_rc < 1e-9f)
+		ekf->p_rc = 1e-9f;
+}
+
+float soc_ekf_bound(const soc_ekf_t* ekf)
+{
+	return 2.0f * sqrtf(ekf->p_soc);
+}
+
+void soc_ekf_horizon_init(soc_ekf_horizon_t* horizon, float time)
+{
+	horizon->time		 = time;
+	horizon->decay		 = expf(-time / RC_TAU);
+	horizon->rc_gain	 = 1.0f + RC_R_RATIO * (1.0f - horizon->decay);
+	horizon->charge_time = time / CAPACITY;
+}
+
+/**
+ * @brief Picks the smaller of the currents that put the voltage on the limit now and at the end
+ *      of the horizon, both taken in the limit's own direction
+ */
+static float hold_limit(float now, float end)
+{
+	/* Already past the limit at no current, nothing in that direction is safe */
+	if (now <= 0.0f || end <= 0.0f)
+		return 0.0f;
+
+	return now < end ? now : end;
+}
+
+void soc_ekf_current_limits(const soc_ekf_t* ekf, float r0, const soc_ekf_horizon_t* horizons, uint8_t num_horizons,
+							float floor, float ceiling, float* discharge, float* charge)
+{
+	/*
+	 * Holding I for t from now, with the OCV curve taken as a straight line over the charge moved
+	 *
+	 *     V(t) = OCV - slope * I * t / CAPACITY - r0 * I - v_rc * d - R1 * I * (1 - d)
+	 *
+	 * where d = exp(-t / RC_TAU). V(t) only turns around once, so its extreme over the horizon
+	 * is at one end or the other. A pair still relaxing from a harder load lifts V as it goes,
+	 * leaving now as the worst point, otherwise it's the end of the horizon.
+	 *
+	 * The OCV, its slope and r0 are the same for both limits and every horizon, so the curve is
+	 * only looked up once and each horizon costs one division, shared by the two limits
+	 */
+	float slope;
+	float open		 = ocv(ekf->soc, &slope);
+	float floor_room = open - floor;
+	float ceil_room	 = open - ceiling;
+	float inv_r0	 = 1.0f / r0;
+
+	float discharge_now = (floor_room - ekf->v_rc) * inv_r0;
+	float charge_now	= (ceil_room - ekf->v_rc) * inv_r0;
+
+	for (uint8_t h = 0; h < num_horizons; h++) {
+		const soc_ekf_horizon_t* horizon = &horizons[h];
+
+		float inv_end = 1.0f / (r0 * horizon->rc_gain + slope * horizon->charge_time);
+		float relaxed = ekf->v_rc * horizon->decay;
+
+		discharge[h] = hold_limit(discharge_now, (floor_room - relaxed) * inv_end);
+		charge[h]	 = hold_limit(-charge_now, -(ceil_room - relaxed) * inv_end);
+	}
+}
@@ -2,7 +2,6 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-#define MIN(a, b) (((a) < (b)) ? (a) : (b))
 extern UART_HandleTypeDef huart4;
 
 acc_data_t* prevAccData;
@@ -16,6 +15,7 @@ nertimer_t charger_max_volt_timer = { .active = false };
 nertimer_t charger_settle_countdown = { .active = false };
 
 nertimer_t can_msg_timer = { .active = false };
+nertimer_t link_stats_timer = { .active = false };
 
 extern TIM_HandleTypeDef htim1;
 extern TIM_HandleTypeDef htim8;
@@ -26,6 +26,7 @@ nertimer_t charger_message_timer;
 
 nertimer_t bootup_timer;
 static const uint16_t CHARGE_MESSAGE_WAIT = 250; /* ms */
+static const uint16_t LINK_STATS_WAIT = 100; /* ms, one chip per message so each chip goes out every 1.2s */
 
 const bool valid_transition_from_to[NUM_STATES][NUM_STATES] = {
 	/*   BOOT,     READY,      CHARGING,   FAULTED	*/
@@ -75,6 +76,8 @@ void handle_boot(acc_data_t* bmsdata)
 
 void init_ready()
 {
+	/* Low latency cell voltages to line up sag with current while driving */
+	segment_set_adc_mode(MD_FAST, DCP_DISABLED);
 	segment_enable_balancing(false);
 	compute_enable_charging(false);
 	return;
@@ -86,13 +89,14 @@ void handle_ready(acc_data_t* bmsdata)
 	if (compute_charger_connected() && is_timer_expired(&bootup_timer)) { //TODO Fix once charger works
 		request_transition(READY_STATE);
 	} else {
-		sm_broadcast_current_limit(bmsdata);
 		return;
 	}
 }
 
 void init_charging()
 {
+	/* Balancing decisions want the most accurate voltages we can get */
+	segment_set_adc_mode(MD_FILTERED, DCP_DISABLED);
 	cancel_timer(&charger_settle_countup);
 	return;
 }
@@ -127,6 +131,7 @@ void handle_charging(acc_data_t* bmsdata)
 
 void init_faulted()
 {
+	segment_set_adc_mode(MD_NORMAL, DCP_DISABLED);
 	segment_enable_balancing(false);
 	compute_enable_charging(false);
 	entered_faulted = true;
@@ -158,6 +163,7 @@ void handle_faulted(acc_data_t* bmsdata)
 void sm_handle_state(acc_data_t* bmsdata)
 {
 	static uint8_t can_msg_to_send = 0;
+	static uint8_t link_stats_chip = 0;
 	enum {ACC_STATUS, CURRENT, BMS_STATUS, CELL_TEMP, CELL_DATA, SEGMENT_TEMP, MC_DISCHARGE, MC_CHARGE, MAX_MSGS};
 	
 	bmsdata->fault_code = sm_fault_return(bmsdata);
@@ -173,8 +179,6 @@ void sm_handle_state(acc_data_t* bmsdata)
 
 	bmsdata->is_charger_connected = compute_charger_connected();
 
-	sm_broadcast_current_limit(bmsdata);
-
 	/* send relevant CAN msgs */
 	// clang-format off
 	if (is_timer_expired(&can_msg_timer) || !is_timer_active(&can_msg_timer))
@@ -213,6 +217,13 @@ void sm_handle_state(acc_data_t* bmsdata)
 		can_msg_to_send = (can_msg_to_send + 1) % MAX_MSGS;
 	}
 	// clang-format on
+
+	/* link health is only for diagnostics, trickle it out one chip at a time */
+	if (is_timer_expired(&link_stats_timer) || !is_timer_active(&link_stats_timer)) {
+		compute_send_link_stats_message(link_stats_chip, segment_get_link_stats(link_stats_chip));
+		link_stats_chip = (link_stats_chip + 1) % NUM_CHIPS;
+		start_timer(&link_stats_timer, LINK_STATS_WAIT);
+	}
 }
 
 void request_transition(BMSState_t next_state)
@@ -237,15 +248,15 @@ uint32_t sm_fault_return(acc_data_t* accData)
 	static nertimer_t ovr_volt_timer = {0};
 	static nertimer_t low_cell_timer = {0};
 	static nertimer_t high_temp_timer = {0};
-	static fault_eval_t* fault_table = NULL;
+	static fault_eval_t fault_table[NUM_FAULTS];
+	static bool fault_table_init = false;
 	static acc_data_t* fault_data = NULL;
 
 	fault_data = accData;
 
-	if (!fault_table)
+	if (!fault_table_init)
 	{
-		/* Note that we are only allocating this table once at runtime, so there is no need to free it */
-		fault_table = (fault_eval_t*) malloc(NUM_FAULTS * sizeof(fault_eval_t));
+		fault_table_init = true;
 		// clang-format off
     											// ___________FAULT ID____________   __________TIMER___________   _____________DATA________________    __OPERATOR__   __________________________THRESHOLD____________________________  _______TIMER LENGTH_________  _____________FAULT CODE_________________    	___OPERATOR 2__ _______________DATA 2______________     __THRESHOLD 2__
         fault_table[0]  = (fault_eval_t) {.id = "Discharge Current Limit", .timer =       ovr_curr_timer, .data_1 =    fault_data->pack_current, .optype_1 = GT, .lim_1 = (fault_data->discharge_limit + DCDC_CURRENT_DRAW)*10 * CURR_ERR_MARG, .timeout =      OVER_CURR_TIME, .code = DISCHARGE_LIMIT_ENFORCEMENT_FAULT,  .optype_2 = NOP/* ---------------------------UNUSED------------------- */ };
@@ -253,7 +264,7 @@ uint32_t sm_fault_return(acc_data_t* accData)
         fault_table[2]  = (fault_eval_t) {.id = "Low Cell Voltage",        .timer =      undr_volt_timer, .data_1 = fault_data->min_voltage.val, .optype_1 = LT, .lim_1 =                                       MIN_VOLT * 10000, .timeout =     UNDER_VOLT_TIME, .code =              CELL_VOLTAGE_TOO_LOW,  .optype_2 = NOP/* ---------------------------UNUSED-------------------*/  };
         fault_table[3]  = (fault_eval_t) {.id = "High Cell Voltage",       .timer =    ovr_chgvolt_timer, .data_1 = fault_data->max_voltage.val, .optype_1 = GT, .lim_1 =                                MAX_CHARGE_VOLT * 10000, .timeout =      OVER_VOLT_TIME, .code =             CELL_VOLTAGE_TOO_HIGH,  .optype_2 = NOP/* ---------------------------UNUSED-------------------*/  };
         fault_table[4]  = (fault_eval_t) {.id = "High Cell Voltage",       .timer =       ovr_volt_timer, .data_1 = fault_data->max_voltage.val, .optype_1 = GT, .lim_1 =                                       MAX_VOLT * 10000, .timeout =      OVER_VOLT_TIME, .code =             CELL_VOLTAGE_TOO_HIGH,  .optype_2 = EQ,  .data_2 = fault_data->is_charger_connected,  .lim_2 = false };
-        fault_table[5]  = (fault_eval_t) {.id = "High Temp",               .timer =      high_temp_timer, .data_1 =    fault_data->max_temp.val, .optype_1 = GT, .lim_1 =                                          MAX_CELL_TEMP, .timeout =      HIGH_TEMP_TIME, .code =                      PACK_TOO_HOT,  .optype_2 = NOP/* ----------------------------------------------------*/  };
+        fault_table[5]  = (fault_eval_t) {.id = "High Temp",               .timer =      high_temp_timer, .data_1 = fault_data->est_max_temp.val, .optype_1 = GT, .lim_1 =                                         MAX_CELL_TEMP, .timeout =      HIGH_TEMP_TIME, .code =                      PACK_TOO_HOT,  .optype_2 = NOP/* ----------------------------------------------------*/  };
     	fault_table[6]  = (fault_eval_t) {.id = "Extremely Low Voltage",   .timer =       low_cell_timer, .data_1 = fault_data->min_voltage.val, .optype_1 = LT, .lim_1 =                                                    900, .timeout =      LOW_CELL_TIME, .code =                  LOW_CELL_VOLTAGE,  .optype_2 = NOP/* --------------------------UNUSED--------------------*/  };
 		fault_table[7]  = (fault_eval_t) {.id = NULL};
 
@@ -277,7 +288,7 @@ uint32_t sm_fault_return(acc_data_t* accData)
 		fault_table[3].data_1 = fault_data->max_voltage.val;
 		fault_table[4].data_1 = fault_data->max_voltage.val;
 		fault_table[4].data_2 = fault_data->is_charger_connected;
-		fault_table[5].data_1 = fault_data->max_temp.val;
+		fault_table[5].data_1 = fault_data->est_max_temp.val;
 		fault_table[6].data_1 = fault_data->min_voltage.val;
 	}
 
@@ -432,41 +443,6 @@ bool sm_balancing_check(acc_data_t* bmsdata)
 	return true;
 }
 
-void sm_broadcast_current_limit(acc_data_t* bmsdata)
-{
-	// States for Boosting State Machine
-	static enum { BOOST_STANDBY, BOOSTING, BOOST_RECHARGE } BoostState;
-
-	static nertimer_t boost_timer;
-	static nertimer_t boost_recharge_timer;
-
-	/* Transitioning out of boost */
-	if (is_timer_expired(&boost_timer) && BoostState == BOOSTING) {
-		BoostState = BOOST_RECHARGE;
-		start_timer(&boost_recharge_timer, BOOST_RECHARGE_TIME);
-	}
-	/* Transition out of boost recharge */
-	if (is_timer_expired(&boost_recharge_timer) && BoostState == BOOST_RECHARGE) {
-		BoostState = BOOST_STANDBY;
-	}
-	/* Transition to boosting */
-	if ((bmsdata->pack_current) > ((bmsdata->cont_DCL) * 10) && BoostState == BOOST_STANDBY) {
-		BoostState = BOOSTING;
-		start_timer(&boost_timer, BOOST_TIME);
-	}
-
-	/* Currently boosting */
-	if (BoostState == BOOSTING || BoostState == BOOST_STANDBY) {
-		bmsdata->boost_setting
-			= MIN(bmsdata->discharge_limit, bmsdata->cont_DCL * CONTDCL_MULTIPLIER);
-	}
-
-	/* Currently recharging boost */
-	else {
-		bmsdata->boost_setting = MIN(bmsdata->cont_DCL, bmsdata->discharge_limit);
-	}
-}
-
 void sm_balance_cells(acc_data_t* bms_data)
 {
 	bool balanceConfig[NUM_CHIPS][NUM_CELLS_PER_CHIP];
@@ -475,7 +451,7 @@ void sm_balance_cells(acc_data_t* bms_data)
 	 * in voltages */
 	for (uint8_t chip = 0; chip < NUM_CHIPS; chip++) {
 		for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
-			uint16_t delta = bms_data->chip_data[chip].voltage[cell]
+			uint16_t delta = CELL_VOLTAGE(bms_data, chip, cell)
 				- (uint16_t)bms_data->min_voltage.val;
 			if (delta > MAX_DELTA_V * 10000)
 				balanceConfig[chip][cell] = true;
@@ -0,0 +1,49 @@
+#include "thermal_model.h"
+#include <math.h>
+
+/*
+ * A segment's cells are one heat capacity C, heated by I^2 R and losing heat to ambient through
+ * a conductance G that the fan adds to
+ *
+ *     C dT/dt = heat - G * (T - AMBIENT_TEMP)
+ *
+ * With the heat and fan held over a step this has an exact solution, so a long gap between
+ * frames steps the same as many short ones. Thermistor readings correct the temperature through a
+ * scalar Kalman filter, which keeps a wrong capacity or conductance from running away between
+ * readings.
+ */
+
+/* Model parameters, may need adjustment once fitted to logged drives */
+#define HEAT_CAPACITY		12000.0f /* J/K, the cells and busbars of one segment */
+#define NATURAL_CONDUCTANCE 2.0f	 /* W/K to ambient with the fan off */
+#define FAN_CONDUCTANCE		10.0f	 /* W/K the fan adds at full duty */
+#define AMBIENT_TEMP		25.0f	 /* C */
+
+/* Noise, one standard deviation each */
+#define MODEL_NOISE	  0.05f /* C per root second, heat the model doesn't account for */
+#define MEASURE_NOISE 1.0f	/* C, thermistor error and readings of different ages in the mean */
+#define INIT_NOISE	  1.0f	/* C */
+
+void thermal_init(thermal_model_t* model, float temp)
+{
+	model->temp = temp;
+	model->p	= INIT_NOISE * INIT_NOISE;
+}
+
+void thermal_predict(thermal_model_t* model, float heat, float fan, float dt)
+{
+	float conductance = NATURAL_CONDUCTANCE + FAN_CONDUCTANCE * fan;
+	float settled	  = AMBIENT_TEMP + heat / conductance;
+	float decay		  = expf(-dt * conductance / HEAT_CAPACITY);
+
+	model->temp = settled + (model->temp - settled) * decay;
+	model->p	= decay * decay * model->p + MODEL_NOISE * MODEL_NOISE * dt;
+}
+
+void thermal_correct(thermal_model_t* model, float measured)
+{
+	float gain = model->p / (model->p + MEASURE_NOISE * MEASURE_NOISE);
+
+	model->temp += gain * (measured - model->temp);
+	model->p -= gain * model->p;
+}
@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""
+Expands the breakpoint lists below into the dense, directly indexed tables in
+Core/Src/lut_tables.c and Core/Inc/lut_tables.h, see Core/Inc/lut.h for how they are read.
+
+Run from the repo root after changing a curve (or `make luts`), and commit the output.
+Limits like MIN_TEMP and MAX_TEMP are read out of Core/Inc/bmsConfig.h.
+"""
+
+import os
+import re
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+CONFIG = os.path.join(ROOT, "Core", "Inc", "bmsConfig.h")
+OUT_C = os.path.join(ROOT, "Core", "Src", "lut_tables.c")
+OUT_H = os.path.join(ROOT, "Core", "Inc", "lut_tables.h")
+
+CELL_RES_Q = 8     # cell resistances are mOhm in Q8.8
+CELL_RECIP_Q = 24  # fraction bits of the resistance reciprocals
+THERM_RATIO_Q = 12 # fraction bits of the thermistor divider ratio
+SOC_Q = 12         # fraction bits of the OCV_LUT input, a state of charge between 0 and 1
+
+
+def config(name):
+    with open(CONFIG) as f:
+        match = re.search(r"#define\s+%s\s+(-?[0-9.]+)" % name, f.read())
+    if match is None:
+        raise SystemExit("%s not found in bmsConfig.h" % name)
+    return float(match.group(1))
+
+
+MIN_TEMP = int(config("MIN_TEMP"))
+MAX_TEMP = int(config("MAX_TEMP"))
+MIN_VOLT = config("MIN_VOLT")
+MAX_VOLT = config("MAX_VOLT")
+
+
+def c_div(a, b):
+    """Integer division that truncates towards zero like C does"""
+    q = abs(a) // abs(b)
+    return q if (a < 0) == (b < 0) else -q
+
+
+def step(points, x):
+    """Value of the breakpoint at or below x, holding the ends"""
+    if x <= points[0][0]:
+        return points[0][1]
+    for (x0, y0), (x1, _) in zip(points, points[1:]):
+        if x < x1:
+            return y0
+    return points[-1][1]
+
+
+def linear(points, x):
+    """Truncated linear interpolation between breakpoints, holding the ends"""
+    if x <= points[0][0]:
+        return points[0][1]
+    for (x0, y0), (x1, y1) in zip(points, points[1:]):
+        if x < x1:
+            return y0 + c_div((y1 - y0) * (x - x0), x1 - x0)
+    return points[-1][1]
+
+
+def every(start, stride, values):
+    """Breakpoints for values that are evenly spaced from start"""
+    return [(start + stride * i, v) for i, v in enumerate(values)]
+
+
+# Curves are evenly spaced breakpoints, (x, y) pairs. Each is expanded into one entry every
+# 1 << shift units of x between x_min and x_max, inputs past either end hold the end value.
+
+# Cell resistance in mOhm against cell temperature in C, nominal curve of the Samsung 18650 INR
+# from the Orion BMS utility. The original table scaled these by (7/5) in C, which integer
+# division made a no-op, so they are taken as is
+CELL_RES = every(MIN_TEMP, 5, [
+    5.52, 4.84, 4.27, 3.68, 3.16, 2.74, 2.4,
+    2.12, 1.98, 1.92, 1.90, 1.90, 1.90, 1.90,
+])
+
+# Continuous discharge and charge current limits in A against temperature in C, from the
+# Samsung 18650 INR limit curves. These have always been applied a 5C step at a time
+CONT_DCL = every(MIN_TEMP, 5, [110, 125, 140, 140, 140, 140, 140, 140, 140, 100, 60, 20, 0, 0])
+CONT_CCL = every(MIN_TEMP, 5, [0, 25, 25, 25, 25, 25, 25, 25, 20, 15, 10, 5, 1, 1])
+
+# Fan PWM out of 255 against the hottest cell in C
+FAN_CURVE = every(MIN_TEMP, 5, [0, 0, 0, 0, 0, 0, 0, 0, 32, 64, 128, 255, 255, 255, 255, 255])
+
+# State of charge in % against the lowest open cell voltage, in 0.1V steps from MIN_VOLT
+SOC_CURVE = every(int(MIN_VOLT * 10000), 1000,
+                  [0, 0, 0, 0, 0, 0, 0, 0, 0, 6, 15, 24, 56, 74, 85, 95, 98, 100])
+
+# Open cell voltage in mV against state of charge in Q12, SOC_CURVE turned around from where it
+# leaves 0% so the model based SOC estimate uses the same curve as the lookup
+def invert_soc_curve():
+    start = max(i for i, (_, soc) in enumerate(SOC_CURVE) if soc == 0)
+    return [(round(soc * (1 << SOC_Q) / 100), volt // 10) for volt, soc in SOC_CURVE[start:]]
+
+
+OCV_CURVE = invert_soc_curve()
+
+# Thermistor resistance in Ohms against temperature in C, one entry per degree
+THERM_MIN_TEMP = -25
+THERM_RES = [
+    157300, 148800, 140300, 131800, 123300, 114800, 108772, 102744, 96716, 90688, 84660, 80328,
+    75996, 71664, 67332, 63000, 59860, 56720, 53580, 50440, 47300, 45004, 42708, 40412, 38116,
+    35820, 34124, 32428, 30732, 29036, 27340, 26076, 24812, 23548, 22284, 21020, 20074, 19128,
+    18182, 17236, 16290, 15576, 14862, 14148, 13434, 12720, 12176, 11632, 11088, 10544, 10000,
+    9584, 9168, 8753, 8337, 7921, 7600, 7279, 6957, 6636, 6315, 6065, 5816, 5566, 5317, 5067,
+    4872, 4676, 4481, 4285, 4090, 3936, 3782, 3627, 3473, 3319, 3197, 3075, 2953, 2831, 2709,
+    2612, 2514, 2417, 2319, 2222, 2144, 2066, 1988, 1910, 1832, 1769, 1706, 1644, 1581, 1518,
+    1467, 1416, 1366, 1315, 1264, 1223, 1181, 1140, 1098, 1057,
+]
+THERM_MAX_TEMP = THERM_MIN_TEMP + len(THERM_RES) - 1
+
+
+def res_q8(t):
+    # Interpolated in Q8.8 the way the firmware always has, not in floating point
+    points = [(x, int(y * (1 << CELL_RES_Q) + 0.5)) for x, y in CELL_RES]
+    return linear(points, t)
+
+
+def res_mohm(t):
+    """Cell resistance in mOhm at t, interpolated in floating point like the float current limits were"""
+    if t <= CELL_RES[0][0]:
+        return CELL_RES[0][1]
+    for (x0, y0), (x1, y1) in zip(CELL_RES, CELL_RES[1:]):
+        if t < x1:
+            return y0 + (y1 - y0) * (t - x0) / (x1 - x0)
+    return CELL_RES[-1][1]
+
+
+def therm_decidegrees(ratio):
+    """Temperature in 0.1C of a thermistor whose divider reads ratio / (1 << THERM_RATIO_Q) of the ref"""
+    if ratio <= 0:
+        return 10 * THERM_MIN_TEMP
+    if ratio >= 1 << THERM_RATIO_Q:
+        return 10 * THERM_MAX_TEMP
+
+    # 10k pull up to the ref, see "thermister decoding" in confluence in shepherd software 22A
+    resistance = 10000 * ((1 << THERM_RATIO_Q) - ratio) / ratio
+    if resistance >= THERM_RES[0]:
+        return 10 * THERM_MIN_TEMP
+    if resistance <= THERM_RES[-1]:
+        return 10 * THERM_MAX_TEMP
+
+    low = max(i for i, r in enumerate(THERM_RES) if r > resistance)
+    span = THERM_RES[low] - THERM_RES[low + 1]
+    return 10 * (THERM_MIN_TEMP + low) + round(10 * (THERM_RES[low] - resistance) / span)
+
+
+class Table:
+    def __init__(self, name, doc, x_min, x_max, shift, value, ctype="int16_t"):
+        self.name = name
+        self.doc = doc
+        self.x_min = x_min
+        self.shift = shift
+        self.ctype = ctype
+        self.len = ((x_max - x_min) >> shift) + 1
+        if x_min + ((self.len - 1) << shift) < x_max:
+            self.len += 1
+        self.values = [value(x_min + (i << shift)) for i in range(self.len)]
+
+    def check(self):
+        lo, hi = {"int16_t": (-32768, 32767), "uint32_t": (0, 2**32 - 1)}[self.ctype]
+        for v in self.values:
+            if not lo <= v <= hi:
+                raise SystemExit("%s entry %d does not fit in %s" % (self.name, v, self.ctype))
+
+
+LUTS = [
+    Table("CELL_RES_LUT", "Cell resistance in mOhm (Q8.8) by cell temperature in C",
+          MIN_TEMP, MAX_TEMP, 0, res_q8),
+    Table("CONT_DCL_LUT", "Continuous discharge current limit in A by temperature in C",
+          MIN_TEMP, MAX_TEMP, 0, lambda t: step(CONT_DCL, t)),
+    Table("CONT_CCL_LUT", "Continuous charge current limit in A by temperature in C",
+          MIN_TEMP, MAX_TEMP, 0, lambda t: step(CONT_CCL, t)),
+    Table("FAN_LUT", "Fan PWM out of 255 by temperature in C",
+          MIN_TEMP, MAX_TEMP, 0, lambda t: linear(FAN_CURVE, t)),
+    Table("SOC_LUT", "State of charge in % by open cell voltage in 0.1mV, 3.2mV per entry",
+          int(MIN_VOLT * 10000), int(MAX_VOLT * 10000), 5, lambda v: linear(SOC_CURVE, v)),
+    Table("OCV_LUT", "Open cell voltage in mV by state of charge in Q%d, 16 per entry" % SOC_Q,
+          0, 1 << SOC_Q, 4, lambda soc: linear(OCV_CURVE, soc)),
+    Table("THERM_LUT", "Thermistor temperature in 0.1C by its divider ratio to the ref in Q%d"
+          % THERM_RATIO_Q, 0, 1 << THERM_RATIO_Q, 2, therm_decidegrees),
+]
+
+# Reciprocal of 10x the resistance at each CELL_RES_LUT entry, so current limits are a multiply and
+# shift. Taken from the unrounded resistance, going through the Q8.8 entries puts the limits up to
+# 2 A off of the float division they replace
+CELL_RES_RECIP = [round((1 << CELL_RECIP_Q) / (10 * res_mohm(MIN_TEMP + i))) for i in range(LUTS[0].len)]
+
+HEADER = "/* Generated by scripts/gen_luts.py from the curves in it, do not edit */\n"
+
+
+def c_array(values, per_line=12):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("\t" + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    for lut in LUTS:
+        lut.check()
+
+    h = [HEADER, "#ifndef LUT_TABLES_H", "#define LUT_TABLES_H", "", '#include "lut.h"', ""]
+    h.append("#define CELL_RES_Q\t\t%d /* fraction bits of CELL_RES_LUT */" % CELL_RES_Q)
+    h.append("#define CELL_RECIP_Q\t%d /* fraction bits of CELL_RES_RECIP */" % CELL_RECIP_Q)
+    h.append("#define THERM_RATIO_Q\t%d /* fraction bits of the THERM_LUT input */" % THERM_RATIO_Q)
+    h.append("#define SOC_Q\t\t\t%d /* fraction bits of the OCV_LUT input */" % SOC_Q)
+    h.append("")
+    for lut in LUTS:
+        h.append("/* %s */" % lut.doc)
+        h.append("extern const lut_t %s;" % lut.name)
+        h.append("")
+    h.append("/* Reciprocal of 10x the resistance at each CELL_RES_LUT entry in Q%d, index with"
+             % CELL_RECIP_Q)
+    h.append(" * lut_index(&CELL_RES_LUT, temp) */")
+    h.append("extern const uint32_t CELL_RES_RECIP[%d];" % len(CELL_RES_RECIP))
+    h.append("")
+    h.append("#endif")
+
+    c = [HEADER, '#include "lut_tables.h"', ""]
+    for lut in LUTS:
+        c.append("static const %s %s_Y[%d] = {" % (lut.ctype, lut.name, lut.len))
+        c.append(c_array(lut.values))
+        c.append("};")
+        c.append("")
+        c.append("const lut_t %s = { %d, %d, %d, %s_Y };" % (lut.name, lut.x_min, lut.shift, lut.len, lut.name))
+        c.append("")
+    c.append("const uint32_t CELL_RES_RECIP[%d] = {" % len(CELL_RES_RECIP))
+    c.append(c_array(CELL_RES_RECIP, 8))
+    c.append("};")
+
+    with open(OUT_H, "w") as f:
+        f.write("\n".join(h) + "\n")
+    with open(OUT_C, "w") as f:
+        f.write("\n".join(c) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,48 @@
+#ifndef HOST_BENCH_H
+#define HOST_BENCH_H
+
+/*
+ * Timing for the host benchmarks, the tests built with HOST_BENCH. These time this machine, not the
+ * F405, so only compare the numbers against each other
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Results land here so the compiler can't drop the work being timed */
+static volatile int32_t bench_sink;
+
+static inline uint64_t bench_now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/**
+ * @brief Runs pass reps times after one warm up pass, and prints how long each of the calls it
+ *      makes took
+ *
+ * @param name
+ * @param pass does calls calls of whatever is being timed
+ * @param reps
+ * @param calls
+ * @return double ns per call
+ */
+static inline double bench_run(const char* name, void (*pass)(void), uint32_t reps, uint32_t calls)
+{
+	pass();
+
+	uint64_t start = bench_now_ns();
+	for (uint32_t rep = 0; rep < reps; rep++)
+		pass();
+	double ns = (double)(bench_now_ns() - start) / ((double)reps * calls);
+
+	printf("  %-40s %10.1f ns\n", name, ns);
+	return ns;
+}
+
+#define BENCH_SPEEDUP(name, reference, now) printf("  %-40s %10.1fx\n", name, (reference) / (now))
+
+#endif
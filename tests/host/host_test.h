@@ -0,0 +1,27 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+/*
+ * Minimal checks for the host tests. Every failed CHECK is printed and counted, and
+ * HOST_TEST_RESULT() turns the count into the exit code make looks at
+ */
+
+#include <stdio.h>
+
+static int host_test_failures = 0;
+
+#define CHECK(cond, ...)                                   \
+	do {                                                   \
+		if (!(cond)) {                                     \
+			printf("%s:%d: FAIL: ", __FILE__, __LINE__);   \
+			printf(__VA_ARGS__);                           \
+			printf("\n");                                  \
+			host_test_failures++;                          \
+		}                                                  \
+	} while (0)
+
+#define HOST_TEST_RESULT()                                                         \
+	(printf("%s: %s\n", __FILE__, host_test_failures ? "FAILED" : "passed"), \
+	 host_test_failures != 0)
+
+#endif
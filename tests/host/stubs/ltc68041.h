@@ -0,0 +1,15 @@
+#ifndef LTC68041_H
+#define LTC68041_H
+
+/* Host stand in for the Embedded-Base LTC6804 driver, only what the headers under test name */
+
+#include "main.h"
+
+#define MD_FAST		1
+#define MD_NORMAL	2
+#define MD_FILTERED 3
+
+#define DCP_DISABLED 0
+#define DCP_ENABLED	 1
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef MAIN_H
+#define MAIN_H
+
+/*
+ * Host stand in for the CubeMX main.h. The modules under test only need the cycle counter and
+ * the interrupt mask from it, see stubs.c
+ */
+
+#include <stdint.h>
+
+typedef struct {
+	volatile uint32_t CYCCNT;
+} host_dwt_t;
+
+extern host_dwt_t host_dwt;
+#define DWT (&host_dwt)
+
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __disable_irq(void) {}
+
+uint32_t HAL_GetTick(void);
+
+#endif
@@ -0,0 +1,58 @@
+#include "eepromdirectory.h"
+#include "main.h"
+#include "timer.h"
+
+host_dwt_t host_dwt = {};
+
+static uint32_t tick = 0;
+
+uint32_t HAL_GetTick(void)
+{
+	return tick;
+}
+
+void host_advance_tick(uint32_t ms)
+{
+	tick += ms;
+}
+
+void start_timer(nertimer_t* timer, uint32_t duration)
+{
+	timer->start_time = tick;
+	timer->end_time	  = tick + duration;
+	timer->active	  = true;
+}
+
+bool is_timer_expired(nertimer_t* timer)
+{
+	return timer->active && (int32_t)(tick - timer->end_time) >= 0;
+}
+
+bool is_timer_active(nertimer_t* timer)
+{
+	return timer->active;
+}
+
+void cancel_timer(nertimer_t* timer)
+{
+	timer->active = false;
+}
+
+uint32_t get_remaining(nertimer_t* timer)
+{
+	if (!timer->active || (int32_t)(tick - timer->end_time) >= 0)
+		return 0;
+
+	return timer->end_time - tick;
+}
+
+/* A blank EEPROM, nothing saved and nothing kept */
+bool eeprom_read_data_key(char* key, void* data, uint16_t size)
+{
+	return false;
+}
+
+bool eeprom_write_data_key(char* key, void* data, uint16_t size)
+{
+	return true;
+}
@@ -0,0 +1,31 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+/*
+ * Host stand in for the Embedded-Base timer, running off of the fake tick in stubs.c so tests can
+ * move time forward with host_advance_tick()
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+	uint32_t start_time;
+	uint32_t end_time;
+	bool active;
+} nertimer_t;
+
+void start_timer(nertimer_t* timer, uint32_t duration);
+bool is_timer_expired(nertimer_t* timer);
+bool is_timer_active(nertimer_t* timer);
+void cancel_timer(nertimer_t* timer);
+uint32_t get_remaining(nertimer_t* timer);
+
+/**
+ * @brief Moves the fake HAL tick forward
+ *
+ * @param ms
+ */
+void host_advance_tick(uint32_t ms);
+
+#endif
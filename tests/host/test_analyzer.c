@@ -0,0 +1,581 @@
+#include "host_test.h"
+#include "analyzer.h"
+#include "cell_res.h"
+#include "lut_tables.h"
+#include "soc_ekf.h"
+#include "timer.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Internals of analyzer.c, the fused passes and the per function reference they replaced */
+typedef struct {
+	int16_t dcl;
+	int16_t ccl;
+} cell_limits_t;
+
+extern bool is_first_reading_;
+extern int16_t cell_voltage_current;
+extern int16_t cell_rc_drop[NUM_CELLS];
+extern soc_ekf_t cell_soc[NUM_CELLS];
+extern uint8_t next_soc_cell;
+extern bool soc_seeded;
+
+void analyze_therms();
+cell_limits_t analyze_cells();
+
+void disable_therms();
+void calc_cell_temps();
+void calc_pack_temps();
+void calc_cell_resistances();
+void calc_open_cell_voltage();
+void calc_pack_voltage_stats();
+int16_t calc_min_cell_dcl();
+int16_t calc_min_cell_ccl();
+void calc_noise_volt_percent();
+void calc_state_of_charge();
+void estimate_cell_resistances();
+
+#define SOC_EKF_CELLS_PER_FRAME (NUM_CELLS_PER_CHIP * 2)
+
+static acc_data_t prev, fused, reference;
+
+/* Every step the analyzer feeds the resistance estimates, linked in with --wrap=cell_res_update */
+void __real_cell_res_update(uint8_t cell, float current_step, float voltage_step, float table_r0);
+static int res_updates		  = 0;
+static float res_largest_step = 0;
+
+void __wrap_cell_res_update(uint8_t cell, float current_step, float voltage_step, float table_r0)
+{
+	res_updates++;
+	if (fabsf(voltage_step) > res_largest_step)
+		res_largest_step = fabsf(voltage_step);
+	__real_cell_res_update(cell, current_step, voltage_step, table_r0);
+}
+
+/**
+ * @brief Fills a frame with random cell voltages, thermistors and noise flags
+ *
+ * @param frame
+ * @param in_limits if every cell should be between the current limit voltages, so neither limit
+ *      bottoms out at 0
+ */
+static void random_chips(acc_data_t* frame, bool in_limits)
+{
+	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+		for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
+			frame->chip_data[c].voltage[cell]		= in_limits ? 31500 + rand() % 4000 : 20000 + rand() % 25000;
+			frame->chip_data[c].noise_reading[cell] = rand() % 2;
+		}
+		for (uint8_t therm = 0; therm < NUM_THERMS_PER_CHIP; therm++) {
+			frame->chip_data[c].thermistor_reading[therm] = MIN_TEMP + rand() % (MAX_TEMP - MIN_TEMP);
+		}
+	}
+}
+
+/**
+ * @brief The fused therm and cell passes have to leave exactly the frame the original functions did
+ */
+static void test_fused_matches_reference()
+{
+	srand(3);
+	for (int run = 0; run < 5000; run++) {
+		memset(&fused, 0, sizeof(fused));
+		bool in_limits = run % 2;
+		random_chips(&fused, in_limits);
+		for (uint8_t i = 0; i < NUM_CELLS; i++) {
+			prev.cell_ocv[i] = 30000 + rand() % 8000;
+			cell_rc_drop[i]	 = in_limits ? rand() % 600 - 300 : rand() % 2000 - 1000;
+		}
+		prev.avg_temp		 = 20 + rand() % 10;
+		fused.pack_current	 = rand() % 60 - 30;
+		cell_voltage_current = rand() % 100 - 30;
+		is_first_reading_	 = run % 7 == 0;
+
+		/* Every so often, resistances that have moved off of the table */
+		if (run % 3 == 0) {
+			cell_res_init();
+			for (uint8_t i = 0; i < NUM_CELLS; i++) {
+				float scale = 0.6f + (rand() % 300) / 100.0f;
+				for (uint8_t step = 0; step < 8; step++) {
+					cell_res_update(i, 20, -scale * 20 * 0.002f, 0.002f);
+				}
+			}
+		}
+
+		prevbmsdata = &prev;
+		bmsdata		= &fused;
+		for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+			memcpy(&CELL_VOLTAGE(bmsdata, c, 0), fused.chip_data[c].voltage, sizeof(fused.chip_data[c].voltage));
+		}
+		memcpy(&reference, &fused, sizeof(fused));
+
+		analyze_therms();
+		cell_limits_t limits = analyze_cells();
+
+		bmsdata = &reference;
+		disable_therms();
+		calc_cell_temps();
+		calc_pack_temps();
+		calc_cell_resistances();
+		calc_open_cell_voltage();
+		calc_pack_voltage_stats();
+		int16_t dcl = calc_min_cell_dcl();
+		int16_t ccl = calc_min_cell_ccl();
+		calc_noise_volt_percent();
+
+		bool same_frame	 = !memcmp(&fused, &reference, sizeof(fused));
+		bool same_limits = limits.dcl == dcl && limits.ccl == ccl;
+		CHECK(same_frame, "run %d: fused frame differs from the reference", run);
+		CHECK(same_limits, "run %d: limits %d/%d, reference %d/%d", run, limits.dcl, limits.ccl, dcl, ccl);
+
+		/* One mismatch says it all */
+		if (!same_frame || !same_limits)
+			return;
+	}
+}
+
+/**
+ * @brief Pushes a drive's worth of frames through the analyzer, returning a hash of every frame
+ *      minus its generations
+ *
+ * @param force_current if every frame should claim a new current generation
+ */
+static unsigned long run_frames(bool force_current)
+{
+	static chipdata_t chips[NUM_CHIPS];
+	uint16_t voltage_gen = 0, therm_gen = 0, current_gen = 0;
+	int16_t current = 0, voltage_current = 0;
+	unsigned long hash = 0;
+
+	srand(5);
+	memset(THERM_DISABLE, 0, sizeof(THERM_DISABLE));
+	for (uint32_t frame = 0; frame < 20000; frame++) {
+		if (frame == 0 || rand() % 4 == 0) {
+			voltage_gen++;
+			voltage_current = current;
+			for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+				for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
+					chips[c].voltage[cell]		 = 24000 + rand() % 19000;
+					chips[c].noise_reading[cell] = rand() % 2;
+				}
+			}
+		}
+		if (frame == 0 || rand() % 3 == 0) {
+			therm_gen++;
+			uint8_t c = rand() % NUM_CHIPS;
+			for (uint8_t therm = 0; therm < NUM_THERMS_PER_CHIP; therm++) {
+				chips[c].thermistor_reading[therm] = 10 + rand() % 30;
+			}
+		}
+		if (rand() % 2) {
+			int16_t next = rand() % 80 - 40;
+			if (next != current) {
+				current = next;
+				current_gen++;
+			}
+		}
+
+		host_advance_tick(rand() % 20);
+
+		acc_data_t* data = analyzer_acquire_frame();
+		memcpy(data->chip_data, chips, sizeof(chips));
+		data->timestamp							= HAL_GetTick();
+		data->pack_current						= current;
+		data->voltage_current					= voltage_current;
+		data->generation[FRAME_SRC_VOLTAGE]		= voltage_gen;
+		data->generation[FRAME_SRC_THERM]		= therm_gen;
+		data->generation[FRAME_SRC_CURRENT]		= force_current ? frame : current_gen;
+		analyzer_push(data);
+
+		for (size_t k = 0; k < sizeof(acc_data_t); k++) {
+			if (k < offsetof(acc_data_t, generation) || k >= offsetof(acc_data_t, generation) + sizeof(data->generation))
+				hash = hash * 131 + ((uint8_t*)data)[k];
+		}
+	}
+
+	return hash;
+}
+
+/**
+ * @brief Skipping stages with no new inputs can't change any frame, so a run that claims every
+ *      frame has a new current has to produce the same frames as one that doesn't
+ * @note the analyzer keeps its state in globals, so each run gets a fresh process
+ */
+static void test_skipped_stages_match()
+{
+	unsigned long hashes[2];
+
+	for (int force = 0; force < 2; force++) {
+		int pipes[2];
+		if (pipe(pipes) != 0)
+			return;
+
+		/* Or the child flushes whatever the parent had buffered again */
+		fflush(stdout);
+		pid_t child = fork();
+		if (child == 0) {
+			/* The reference build prints its cycle counts every frame */
+			if (!freopen("/dev/null", "w", stdout))
+				_exit(1);
+			unsigned long hash = run_frames(force);
+			if (write(pipes[1], &hash, sizeof(hash)) != sizeof(hash))
+				_exit(1);
+			_exit(0);
+		}
+
+		int status;
+		waitpid(child, &status, 0);
+		CHECK(read(pipes[0], &hashes[force], sizeof(hashes[force])) == sizeof(hashes[force]),
+			  "run %d didn't finish", force);
+		close(pipes[0]);
+		close(pipes[1]);
+	}
+
+	CHECK(hashes[0] == hashes[1], "skipped stages changed the frames, %lx vs %lx", hashes[0], hashes[1]);
+}
+
+/**
+ * @brief Each filter has to be stepped with the charge counted since it last ran, to the mAs. A
+ *      small load moves less than a mAh between two steps, and has to be seen all the same
+ */
+static void test_soc_counts_fine_charge()
+{
+	static soc_ekf_t expected[NUM_CELLS];
+
+	memset(&fused, 0, sizeof(fused));
+	bmsdata = &fused;
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		fused.cell_ocv[i]		 = 36000;
+		fused.cell_voltage[i]	 = 35990;
+		fused.cell_resistance[i] = 2 << CELL_RES_Q;
+	}
+	fused.voltage_current				= 1;
+	fused.net_discharged				= 0xFFFFFF00; /* about to wrap */
+	fused.generation[FRAME_SRC_VOLTAGE] = 1;
+	is_first_reading_					= true;
+	soc_seeded							= false;
+	calc_state_of_charge();
+	is_first_reading_ = false;
+
+	for (int frame = 0; frame < 12; frame++) {
+		/* 0.5 A over 50 ms */
+		fused.timestamp += 50;
+		fused.net_discharged += 25;
+		fused.generation[FRAME_SRC_VOLTAGE]++;
+
+		memcpy(expected, cell_soc, sizeof(expected));
+		for (uint8_t n = 0; n < SOC_EKF_CELLS_PER_FRAME; n++) {
+			uint8_t i = (next_soc_cell + n) % NUM_CELLS;
+			float r0  = fused.cell_resistance[i] / (1000.0f * (1 << CELL_RES_Q));
+
+			/* Frames since the filter last ran, every filter starts from the first reading */
+			int32_t frames = frame < NUM_CELLS / SOC_EKF_CELLS_PER_FRAME ? frame + 1
+																		  : NUM_CELLS / SOC_EKF_CELLS_PER_FRAME;
+			soc_ekf_predict(&expected[i], 25 * frames / 1000.0f, 50 * frames / 1000.0f, r0);
+			soc_ekf_correct(&expected[i], fused.cell_voltage[i] / 10000.0f, fused.voltage_current, r0);
+		}
+		calc_state_of_charge();
+
+		CHECK(!memcmp(expected, cell_soc, sizeof(expected)), "frame %d: filters weren't stepped with the mAs counted",
+			  frame);
+	}
+}
+
+/**
+ * @brief Healthy cells, where the OCV check rather than the filters tends to set the peak, have
+ *      to publish short and continuous limits no higher than the peak on every frame
+ * @return int frames where a longer horizon was over the peak
+ */
+static int count_over_peak()
+{
+	static chipdata_t chips[NUM_CHIPS];
+	int over_peak = 0;
+
+	srand(9);
+	memset(THERM_DISABLE, 0, sizeof(THERM_DISABLE));
+	for (uint16_t frame = 0; frame < 2000; frame++) {
+		for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+			for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
+				chips[c].voltage[cell]		 = 30500 + rand() % 5000;
+				chips[c].noise_reading[cell] = 0;
+			}
+			for (uint8_t therm = 0; therm < NUM_THERMS_PER_CHIP; therm++) {
+				chips[c].thermistor_reading[therm] = 20 + rand() % 10;
+			}
+		}
+		host_advance_tick(50);
+
+		acc_data_t* data = analyzer_acquire_frame();
+		memcpy(data->chip_data, chips, sizeof(chips));
+		data->timestamp = HAL_GetTick();
+		for (uint8_t src = 0; src < NUM_FRAME_SOURCES; src++) {
+			data->generation[src] = frame;
+		}
+		analyzer_push(data);
+
+		for (uint8_t h = 0; h < NUM_LIMIT_HORIZONS; h++) {
+			if (data->dcl_horizon[h] > data->discharge_limit || data->ccl_horizon[h] > data->charge_limit)
+				over_peak++;
+		}
+	}
+
+	return over_peak;
+}
+
+/**
+ * @brief Runs a count in a fresh process, so it starts from the analyzer's boot state
+ *
+ * @return int the count, -1 if the child didn't finish
+ */
+static int count_in_child(int (*count)())
+{
+	int pipes[2];
+	if (pipe(pipes) != 0)
+		return -1;
+
+	fflush(stdout);
+	pid_t child = fork();
+	if (child == 0) {
+		if (!freopen("/dev/null", "w", stdout))
+			_exit(1);
+		int result = count();
+		if (write(pipes[1], &result, sizeof(result)) != sizeof(result))
+			_exit(1);
+		_exit(0);
+	}
+
+	int status, result = -1;
+	waitpid(child, &status, 0);
+	if (read(pipes[0], &result, sizeof(result)) != sizeof(result))
+		result = -1;
+	close(pipes[0]);
+	close(pipes[1]);
+
+	return result;
+}
+
+static void test_horizons_capped_by_peak()
+{
+	int over_peak = count_in_child(count_over_peak);
+	CHECK(over_peak == 0, "%d limits over the published peak", over_peak);
+}
+
+/**
+ * @brief Brings a pack sitting at 30C up from boot, one mux channel per thermistor generation like
+ *      the scan does, with every thermistor reading 0 until its channel comes in
+ *
+ * @return int frames after the first full scan where the estimates strayed from 30C
+ */
+static int count_cold_estimates()
+{
+	static chipdata_t chips[NUM_CHIPS];
+	int cold = 0;
+
+	memset(THERM_DISABLE, 0, sizeof(THERM_DISABLE));
+	for (uint16_t frame = 0; frame < 400; frame++) {
+		uint8_t channel = frame % (NUM_THERMS_PER_CHIP / 2);
+		for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+			for (uint8_t cell = 0; cell < NUM_CELLS_PER_CHIP; cell++) {
+				chips[c].voltage[cell] = 34000;
+			}
+			chips[c].thermistor_reading[channel]							= 30;
+			chips[c].thermistor_reading[channel + NUM_THERMS_PER_CHIP / 2] = 30;
+		}
+		host_advance_tick(50);
+
+		acc_data_t* data = analyzer_acquire_frame();
+		memcpy(data->chip_data, chips, sizeof(chips));
+		data->timestamp						= HAL_GetTick();
+		data->generation[FRAME_SRC_VOLTAGE] = 1;
+		data->generation[FRAME_SRC_THERM]	= frame + 1;
+		analyzer_push(data);
+
+		if (frame >= NUM_THERMS_PER_CHIP / 2 && (data->est_min_temp.val < 29 || data->est_max_temp.val > 31))
+			cold++;
+	}
+
+	return cold;
+}
+
+/**
+ * @brief The thermal models can't start from the thermistors that haven't been read yet, or the
+ *      estimates run cold and derate the pack for seconds after every boot
+ */
+static void test_thermal_waits_for_scan()
+{
+	int cold = count_in_child(count_cold_estimates);
+	CHECK(cold == 0, "%d frames estimated away from 30C after the first full scan", cold);
+}
+
+/**
+ * @brief The frames before the first conversion finishes hold zeroed voltages. The filters have
+ *      to wait out those frames, keep publishing the SOC they had, then start from the first real
+ *      voltages and hold there
+ */
+static void test_soc_waits_for_voltages()
+{
+	memset(&prev, 0, sizeof(prev));
+	memset(&fused, 0, sizeof(fused));
+	prev.soc		  = 57;
+	prev.soc_bound	  = 10;
+	prev.pack_ah	  = 200;
+	prevbmsdata		  = &prev;
+	bmsdata			  = &fused;
+	is_first_reading_ = true;
+	soc_seeded		  = false;
+
+	calc_state_of_charge();
+	CHECK(!soc_seeded, "filters started from a frame with no voltages");
+	CHECK(fused.soc == 57 && fused.soc_bound == 10 && fused.pack_ah == 200, "published %d%% +- %d, %d Ah * 10 before any voltages",
+		  fused.soc, fused.soc_bound, fused.pack_ah);
+	is_first_reading_ = false;
+
+	/* Every cell resting at the OCV of 80% */
+	uint16_t rest = lut_lookup(&OCV_LUT, 4 * (1 << SOC_Q) / 5) * 10;
+	for (int frame = 1; frame <= 2000; frame++) {
+		memcpy(&prev, &fused, sizeof(prev));
+		for (uint8_t i = 0; i < NUM_CELLS; i++) {
+			fused.cell_ocv[i]		 = rest;
+			fused.cell_voltage[i]	 = rest;
+			fused.cell_resistance[i] = 2 << CELL_RES_Q;
+		}
+		fused.timestamp += 50;
+		fused.generation[FRAME_SRC_VOLTAGE] = frame;
+		calc_state_of_charge();
+
+		if (frame == 1 || frame == 2000) {
+			CHECK(fused.soc >= 78 && fused.soc <= 82, "frame %d: %d%% for cells resting at 80%%", frame, fused.soc);
+		}
+	}
+}
+
+/**
+ * @brief The step from the zeroed frames before the first conversion to the first real voltages
+ *      isn't the cells' response to anything, only steps between real voltages can be fitted
+ */
+static void test_res_waits_for_voltages()
+{
+	memset(&prev, 0, sizeof(prev));
+	memset(&fused, 0, sizeof(fused));
+	prevbmsdata		  = &prev;
+	bmsdata			  = &fused;
+	is_first_reading_ = true;
+	estimate_cell_resistances();
+	is_first_reading_ = false;
+
+	const struct {
+		int16_t current;
+		uint16_t voltage;
+	} frames[] = { { 20, 35000 }, { 40, 34600 } };
+
+	res_updates		 = 0;
+	res_largest_step = 0;
+	for (uint8_t frame = 0; frame < 2; frame++) {
+		memcpy(&prev, &fused, sizeof(prev));
+		for (uint8_t i = 0; i < NUM_CELLS; i++) {
+			fused.cell_voltage[i] = frames[frame].voltage;
+			fused.cell_temp[i]	  = 25;
+		}
+		fused.voltage_current				= frames[frame].current;
+		fused.generation[FRAME_SRC_VOLTAGE] = frame + 1;
+		estimate_cell_resistances();
+
+		/* Only the second real frame has a step to fit */
+		CHECK(res_updates == frame * NUM_CELLS, "frame %d: %d resistance updates", frame + 1, res_updates);
+	}
+	CHECK(res_largest_step < 0.05f, "fitted a %.3f V step", res_largest_step);
+}
+
+#ifdef HOST_BENCH
+#include "host_bench.h"
+
+static acc_data_t bench_frame;
+
+/* Both passes start from a copy of the same frame, so each time includes the one memcpy */
+static void fused_pass()
+{
+	memcpy(&fused, &bench_frame, sizeof(fused));
+	bmsdata = &fused;
+
+	analyze_therms();
+	bench_sink += analyze_cells().dcl;
+}
+
+static void reference_pass()
+{
+	memcpy(&reference, &bench_frame, sizeof(reference));
+	bmsdata = &reference;
+
+	disable_therms();
+	calc_cell_temps();
+	calc_pack_temps();
+	calc_cell_resistances();
+	calc_open_cell_voltage();
+	calc_pack_voltage_stats();
+	bench_sink += calc_min_cell_dcl();
+	bench_sink += calc_min_cell_ccl();
+	calc_noise_volt_percent();
+}
+
+/**
+ * @brief Times the fused therm and cell passes against the per function analysis they replaced,
+ *      on a frame with every cell inside its limits and resistances off of the table
+ */
+static void bench()
+{
+	srand(9);
+	memset(&bench_frame, 0, sizeof(bench_frame));
+	random_chips(&bench_frame, true);
+	for (uint8_t c = 0; c < NUM_CHIPS; c++) {
+		memcpy(&CELL_VOLTAGE(&bench_frame, c, 0), bench_frame.chip_data[c].voltage,
+			   sizeof(bench_frame.chip_data[c].voltage));
+	}
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		prev.cell_ocv[i] = 30000 + rand() % 8000;
+		cell_rc_drop[i]	 = rand() % 600 - 300;
+	}
+	prev.avg_temp			 = 25;
+	bench_frame.pack_current = 20;
+	cell_voltage_current	 = 20;
+	is_first_reading_		 = false;
+	prevbmsdata				 = &prev;
+
+	cell_res_init();
+	for (uint8_t i = 0; i < NUM_CELLS; i++) {
+		for (uint8_t step = 0; step < 8; step++) {
+			cell_res_update(i, 20, -1.4f * 20 * 0.002f, 0.002f);
+		}
+	}
+
+	fused_pass();
+	reference_pass();
+	CHECK(!memcmp(&fused, &reference, sizeof(fused)), "benchmark frame analyzed differently by the passes");
+
+	printf("analysis, per frame:\n");
+	double per_function = bench_run("per function reference", reference_pass, 20000, 1);
+	double fused_passes = bench_run("analyze_therms and analyze_cells", fused_pass, 20000, 1);
+	BENCH_SPEEDUP("speedup", per_function, fused_passes);
+}
+#endif
+
+int main()
+{
+	test_fused_matches_reference();
+	test_soc_counts_fine_charge();
+	test_soc_waits_for_voltages();
+	test_res_waits_for_voltages();
+	test_skipped_stages_match();
+	test_horizons_capped_by_peak();
+	test_thermal_waits_for_scan();
+
+#ifdef HOST_BENCH
+	bench();
+#endif
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,106 @@
+#include "host_test.h"
+#include "cell_res.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define TABLE_R0 0.002f /* Ohm */
+
+static float noise(float amplitude)
+{
+	return amplitude * (2.0f * rand() / RAND_MAX - 1.0f);
+}
+
+/**
+ * @brief Feeds a cell current steps from a cell whose R0 is true_scale times the table, with a
+ *      couple of mV of noise on each voltage step
+ *
+ * @return float the scale the estimate reports
+ */
+static float estimate(uint8_t cell, float true_scale, int steps)
+{
+	for (int step = 0; step < steps; step++) {
+		float current_step = (rand() % 2 ? 1 : -1) * (CELL_RES_MIN_STEP + rand() % 80);
+		float voltage_step = -current_step * TABLE_R0 * true_scale + noise(0.002f);
+		cell_res_update(cell, current_step, voltage_step, TABLE_R0);
+	}
+
+	return cell_res_get_scale(cell) / (float)(1 << CELL_RES_SCALE_Q);
+}
+
+static void test_holds_table_until_trusted()
+{
+	cell_res_init();
+
+	CHECK(cell_res_get_scale(0) == 1 << CELL_RES_SCALE_Q, "fresh estimate isn't the table");
+	CHECK(cell_res_get_inv_scale(0) == 1 << CELL_RES_SCALE_Q, "fresh inverse isn't the table");
+
+	/* A step too small to see past the noise doesn't earn any trust */
+	cell_res_update(0, 0.1f, -0.1f * TABLE_R0 * 2.0f, TABLE_R0);
+	CHECK(cell_res_get_scale(0) == 1 << CELL_RES_SCALE_Q, "moved off of the table on a 0.1 A step");
+}
+
+static void test_converges()
+{
+	const float scales[] = { 0.7f, 1.0f, 1.6f, 2.2f };
+
+	srand(4);
+	cell_res_init();
+	for (uint8_t cell = 0; cell < sizeof(scales) / sizeof(scales[0]); cell++) {
+		float scale		= estimate(cell, scales[cell], 200);
+		float inv_scale = cell_res_get_inv_scale(cell) / (float)(1 << CELL_RES_SCALE_Q);
+
+		CHECK(fabsf(scale - scales[cell]) < 0.05f * scales[cell], "x%.1f cell estimated at x%.3f",
+			  scales[cell], scale);
+		CHECK(fabsf(scale * inv_scale - 1.0f) < 0.01f, "x%.1f cell, scale %.3f and inverse %.3f disagree",
+			  scales[cell], scale, inv_scale);
+	}
+}
+
+static void test_follows_ageing()
+{
+	srand(5);
+	cell_res_init();
+	estimate(0, 1.0f, 200);
+
+	/* The forgetting factor has to let a cell that aged move the estimate */
+	float scale = estimate(0, 1.5f, 300);
+	CHECK(fabsf(scale - 1.5f) < 0.075f, "aged cell estimated at x%.3f, expected x1.5", scale);
+}
+
+static void test_rejects_outliers()
+{
+	srand(6);
+	cell_res_init();
+	estimate(0, 1.2f, 200);
+
+	/* A couple of steps that straddled a current edge shouldn't move a settled estimate */
+	cell_res_update(0, 50, 0.5f, TABLE_R0);
+	cell_res_update(0, -50, -0.5f, TABLE_R0);
+	float scale = cell_res_get_scale(0) / (float)(1 << CELL_RES_SCALE_Q);
+	CHECK(fabsf(scale - 1.2f) < 0.06f, "two outliers moved the estimate to x%.3f", scale);
+}
+
+/**
+ * @brief A settled estimate that keeps missing by more than it can reach in one step has to start
+ *      over from the table and find the new resistance
+ */
+static void test_restarts()
+{
+	srand(7);
+	cell_res_init();
+	estimate(0, 1.0f, 200);
+
+	float scale = estimate(0, 2.2f, 30);
+	CHECK(fabsf(scale - 2.2f) < 0.11f, "estimate stuck at x%.3f after the cell went to x2.2", scale);
+}
+
+int main()
+{
+	test_holds_table_until_trusted();
+	test_converges();
+	test_follows_ageing();
+	test_rejects_outliers();
+	test_restarts();
+
+	return HOST_TEST_RESULT();
+}
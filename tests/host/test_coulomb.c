@@ -0,0 +1,98 @@
+#include "host_test.h"
+#include "coulomb.h"
+#include <stdlib.h>
+
+#define SAMPLE_RATE 4000 /* Hz, the current sampling interrupt's */
+#define NOISE		100	 /* mA either way, inside the rest spread */
+
+/* The counter keeps its state in globals, so the tests run in order and only look at what moved */
+static int64_t net_mah()
+{
+	return (int64_t)coulomb_get_discharged() - coulomb_get_charged();
+}
+
+/**
+ * @brief Feeds a steady current, as the sensor reads it, with noise on every sample
+ */
+static void feed(int32_t reading, uint32_t seconds)
+{
+	for (uint32_t sample = 0; sample < seconds * SAMPLE_RATE; sample++) {
+		coulomb_add_sample(reading + rand() % (2 * NOISE + 1) - NOISE);
+	}
+}
+
+/**
+ * @brief A small steady load with the contactors closed is charge drawn, not offset, and all of
+ *      it has to be counted
+ */
+static void test_counts_small_load()
+{
+	int64_t before = net_mah();
+	feed(200, 3600);
+
+	int64_t counted = net_mah() - before;
+	CHECK(counted >= 198 && counted <= 202, "an hour at 200 mA counted as %lld mAh", (long long)counted);
+	CHECK(coulomb_get_offset() == 0, "a 200 mA load was taken for %d mA of offset", coulomb_get_offset());
+}
+
+/**
+ * @brief With the contactors open, whatever the sensor reads is its offset, and has to be taken
+ *      out of everything counted after they close
+ */
+static void test_learns_offset_open()
+{
+	coulomb_set_open(true);
+	feed(300, 60);
+	coulomb_set_open(false);
+
+	int32_t offset = coulomb_get_offset();
+	CHECK(offset >= 290 && offset <= 310, "learned %d mA of offset, sensor read 300 mA", offset);
+
+	int64_t before = net_mah();
+	feed(300 + 500, 3600);
+
+	int64_t counted = net_mah() - before;
+	CHECK(counted >= 495 && counted <= 505, "an hour at 500 mA counted as %lld mAh", (long long)counted);
+}
+
+/**
+ * @brief A load still flowing as the contactors open can't pull the offset with it
+ */
+static void test_ignores_load_before_open()
+{
+	int32_t before = coulomb_get_offset();
+
+	feed(5000, 1);
+	coulomb_set_open(true);
+	feed(before, 10);
+	coulomb_set_open(false);
+
+	int32_t offset = coulomb_get_offset();
+	CHECK(abs(offset - before) <= 10, "offset moved from %d mA to %d mA", before, offset);
+}
+
+/**
+ * @brief Once settled at rest with the contactors closed, the offset has to follow slow drift
+ */
+static void test_follows_drift()
+{
+	int32_t start = coulomb_get_offset();
+
+	feed(start + 30, 600);
+
+	int32_t offset = coulomb_get_offset();
+	CHECK(abs(offset - (start + 30)) <= 5, "sensor drifted to %d mA, offset stuck at %d mA", start + 30, offset);
+}
+
+int main()
+{
+	srand(8);
+	coulomb_init(SAMPLE_RATE);
+
+	test_counts_small_load();
+	test_learns_offset_open();
+	test_ignores_load_before_open();
+	test_follows_drift();
+
+	return HOST_TEST_RESULT();
+}
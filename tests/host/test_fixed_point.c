@@ -0,0 +1,70 @@
+#include "host_test.h"
+#include "bmsConfig.h"
+#include "lut_tables.h"
+#include <math.h>
+#include <stdlib.h>
+
+/* analyzer.c, the DCL/CCL candidate for one cell */
+uint16_t cell_current_limit(int32_t headroom, uint32_t recip);
+
+/* The float resistance curve the fixed point replaced, mOhm every 5C from MIN_TEMP */
+static const float TEMP_TO_CELL_RES[14] = {
+	5.52f, 4.84f, 4.27f, 3.68f, 3.16f, 2.74f, 2.4f, 2.12f, 1.98f, 1.92f, 1.90f, 1.90f, 1.90f, 1.90f,
+};
+
+/**
+ * @brief Cell resistance the float code interpolated at temp, held past the end of the curve
+ */
+static float float_resistance(int temp)
+{
+	int index = (temp - MIN_TEMP) / 5;
+	if (index >= 13)
+		return TEMP_TO_CELL_RES[13];
+
+	float step = (TEMP_TO_CELL_RES[index + 1] - TEMP_TO_CELL_RES[index]) / 5;
+	return TEMP_TO_CELL_RES[index] + step * ((temp - MIN_TEMP) % 5);
+}
+
+static void test_resistance_table()
+{
+	for (int temp = MIN_TEMP; temp <= MAX_TEMP; temp++) {
+		float table = lut_lookup(&CELL_RES_LUT, temp) / (float)(1 << CELL_RES_Q);
+		float error = table - float_resistance(temp);
+
+		/* Q8.8 rounding of the breakpoints plus the truncated interpolation, at most an LSB each */
+		CHECK(fabsf(error) <= 2.0f / (1 << CELL_RES_Q), "%dC: %.4f mOhm, float %.4f", temp, table,
+			  float_resistance(temp));
+	}
+}
+
+/**
+ * @brief The multiply and shift has to land within 1 A (one LSB) of the float division it
+ *      replaced, for every temperature and every headroom up to 2V
+ */
+static void test_current_limits()
+{
+	int worst = 0;
+
+	for (int temp = MIN_TEMP; temp <= MAX_TEMP; temp++) {
+		uint32_t recip = CELL_RES_RECIP[lut_index(&CELL_RES_LUT, temp)];
+
+		for (int32_t headroom = -100; headroom <= 20000; headroom++) {
+			uint16_t fixed = cell_current_limit(headroom, recip);
+			uint16_t exact = headroom > 0 ? (uint16_t)(headroom / (float_resistance(temp) * 10)) : 0;
+
+			int error = abs((int)fixed - exact);
+			if (error > worst)
+				worst = error;
+		}
+	}
+
+	CHECK(worst <= 1, "current limits up to %d A off of the float division", worst);
+}
+
+int main()
+{
+	test_resistance_table();
+	test_current_limits();
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,206 @@
+#include "host_test.h"
+#include "pec15.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief PEC15 a bit at a time, straight from the LTC6804 datasheet's description
+ */
+static uint16_t pec15_bitwise(uint8_t len, const uint8_t* data)
+{
+	uint16_t remainder = 16;
+
+	for (uint8_t i = 0; i < len; i++) {
+		for (int8_t bit = 7; bit >= 0; bit--) {
+			uint16_t in = ((data[i] >> bit) & 1) ^ ((remainder >> 14) & 1);
+			remainder	= (remainder << 1) & 0x7FFF;
+			if (in)
+				remainder ^= 0x4599;
+		}
+	}
+
+	return remainder << 1;
+}
+
+static void test_datasheet_vectors()
+{
+	/* The datasheet works 0x0001 through to 0x3D6E, and RDCVA's PEC is given as 0x07C2 */
+	const uint8_t example[] = { 0x00, 0x01 };
+	const uint8_t rdcva[]	= { 0x00, 0x04 };
+
+	CHECK(pec15_compute(2, example) == 0x3D6E, "PEC of 0x0001 is %04x", pec15_compute(2, example));
+	CHECK(pec15_compute(2, rdcva) == 0x07C2, "PEC of RDCVA is %04x", pec15_compute(2, rdcva));
+}
+
+static void test_matches_bitwise()
+{
+	uint8_t buf[64];
+
+	srand(1);
+	for (int run = 0; run < 20000; run++) {
+		uint8_t len = rand() % sizeof(buf);
+		for (uint8_t i = 0; i < len; i++) {
+			buf[i] = rand();
+		}
+
+		uint16_t fast = pec15_compute(len, buf);
+		uint16_t slow = pec15_bitwise(len, buf);
+		CHECK(fast == slow, "len %d: %04x, bit by bit %04x", len, fast, slow);
+		if (fast != slow)
+			return;
+	}
+}
+
+static void test_verify_chain()
+{
+	/* A ten segment pack, past what a 16 bit mask could hold */
+	enum { CHIPS = 20 };
+	uint8_t chain[CHIPS * PEC15_REG_STRIDE];
+
+	srand(2);
+	for (uint8_t chip = 0; chip < CHIPS; chip++) {
+		uint8_t* reg = &chain[chip * PEC15_REG_STRIDE];
+		for (uint8_t i = 0; i < PEC15_DATA_LEN; i++) {
+			reg[i] = rand();
+		}
+		uint16_t pec			= pec15_bitwise(PEC15_DATA_LEN, reg);
+		reg[PEC15_DATA_LEN]		= pec >> 8;
+		reg[PEC15_DATA_LEN + 1] = pec;
+	}
+
+	uint32_t failed = 0xFFFFFFFF;
+	CHECK(pec15_verify_chain(chain, CHIPS, &failed) == 0 && failed == 0, "clean chain failed %05x", failed);
+
+	/* Flipped bits in two registers and one PEC */
+	chain[3 * PEC15_REG_STRIDE + 2] ^= 0x10;
+	chain[10 * PEC15_REG_STRIDE + PEC15_DATA_LEN + 1] ^= 0x01;
+	chain[18 * PEC15_REG_STRIDE + 5] ^= 0x80;
+	CHECK(pec15_verify_chain(chain, CHIPS, &failed) == 3 && failed == ((1u << 3) | (1u << 10) | (1u << 18)),
+		  "corrupted chips 3, 10 and 18, got %05x", failed);
+}
+
+#ifdef HOST_BENCH
+#include "host_bench.h"
+
+/* A full readback, 12 chips across every cell voltage group and aux group A */
+enum { BENCH_CHIPS = 12, BENCH_GROUPS = 5 };
+static uint8_t bench_chain[BENCH_GROUPS][BENCH_CHIPS * PEC15_REG_STRIDE];
+static uint16_t crc15_table[256];
+
+/**
+ * @brief The byte at a time table and pec15_calc() from the Linduino LTC68041 driver, which
+ *      pec15_compute replaced
+ */
+static void init_pec15_table()
+{
+	for (int i = 0; i < 256; i++) {
+		uint16_t remainder = i << 7;
+		for (int bit = 8; bit > 0; --bit) {
+			if (remainder & 0x4000) {
+				remainder = ((remainder << 1));
+				remainder = (remainder ^ 0x4599);
+			} else {
+				remainder = ((remainder << 1));
+			}
+		}
+		crc15_table[i] = remainder & 0xFFFF;
+	}
+}
+
+static uint16_t pec15_calc(uint8_t len, const uint8_t* data)
+{
+	uint16_t remainder = 16;
+	for (uint8_t i = 0; i < len; i++) {
+		uint16_t addr = ((remainder >> 7) ^ data[i]) & 0xff;
+		remainder	  = (remainder << 8) ^ crc15_table[addr];
+	}
+
+	return remainder * 2;
+}
+
+/**
+ * @brief Checks every chip the way segment.c did before pec15_verify_chain, with one call per
+ *      register and the received PEC rebuilt to compare against
+ */
+static uint32_t verify_with(uint16_t (*pec)(uint8_t, const uint8_t*), const uint8_t* chain)
+{
+	uint32_t failed = 0;
+	for (uint8_t chip = 0; chip < BENCH_CHIPS; chip++) {
+		const uint8_t* reg = &chain[chip * PEC15_REG_STRIDE];
+		uint16_t received  = (reg[PEC15_DATA_LEN] << 8) | reg[PEC15_DATA_LEN + 1];
+		if (pec(PEC15_DATA_LEN, reg) != received)
+			failed |= 1u << chip;
+	}
+
+	return failed;
+}
+
+static void bitwise_pass()
+{
+	for (int group = 0; group < BENCH_GROUPS; group++)
+		bench_sink += verify_with(pec15_bitwise, bench_chain[group]);
+}
+
+static void table_pass()
+{
+	for (int group = 0; group < BENCH_GROUPS; group++)
+		bench_sink += verify_with(pec15_calc, bench_chain[group]);
+}
+
+static void compute_pass()
+{
+	for (int group = 0; group < BENCH_GROUPS; group++)
+		bench_sink += verify_with(pec15_compute, bench_chain[group]);
+}
+
+static void chain_pass()
+{
+	for (int group = 0; group < BENCH_GROUPS; group++) {
+		uint32_t failed;
+		bench_sink += pec15_verify_chain(bench_chain[group], BENCH_CHIPS, &failed);
+	}
+}
+
+static void bench()
+{
+	init_pec15_table();
+
+	srand(3);
+	for (int group = 0; group < BENCH_GROUPS; group++) {
+		for (uint8_t chip = 0; chip < BENCH_CHIPS; chip++) {
+			uint8_t* reg = &bench_chain[group][chip * PEC15_REG_STRIDE];
+			for (uint8_t i = 0; i < PEC15_DATA_LEN; i++) {
+				reg[i] = rand();
+			}
+			uint16_t pec			= pec15_bitwise(PEC15_DATA_LEN, reg);
+			reg[PEC15_DATA_LEN]		= pec >> 8;
+			reg[PEC15_DATA_LEN + 1] = pec;
+		}
+	}
+
+	for (int group = 0; group < BENCH_GROUPS; group++)
+		CHECK(verify_with(pec15_calc, bench_chain[group]) == 0, "the Linduino table disagrees with the bitwise PEC");
+
+	printf("PEC15 checks, per full chain readback:\n");
+	double bitwise = bench_run("bitwise", bitwise_pass, 20000, 1);
+	double table   = bench_run("byte table, pec15_calc", table_pass, 20000, 1);
+	double compute = bench_run("pec15_compute per chip", compute_pass, 20000, 1);
+	double chain   = bench_run("pec15_verify_chain", chain_pass, 20000, 1);
+	BENCH_SPEEDUP("pec15_compute over pec15_calc", table, compute);
+	BENCH_SPEEDUP("pec15_verify_chain over bitwise", bitwise, chain);
+	BENCH_SPEEDUP("pec15_verify_chain over pec15_calc", table, chain);
+}
+#endif
+
+int main()
+{
+	test_datasheet_vectors();
+	test_matches_bitwise();
+	test_verify_chain();
+
+#ifdef HOST_BENCH
+	bench();
+#endif
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,198 @@
+#include "host_test.h"
+#include "lut_tables.h"
+#include "soc_ekf.h"
+#include <math.h>
+#include <stdlib.h>
+
+/*
+ * A simulated cell, the model the filter assumes (OCV curve, series resistance, one RC pair) but
+ * with its own RC time constant and gain, a biased current sensor and voltage noise
+ */
+#define CELL_CAPACITY (35 * 3600.0) /* As */
+#define CELL_R0		  0.002			/* Ohm */
+#define SIM_DT		  0.1			/* s */
+#define CORRECT_EVERY 5				/* simulation steps per filter step */
+
+typedef struct {
+	double soc;
+	double v_rc;
+	double tau; /* s */
+	double rc_gain; /* RC pair resistance over R0 */
+} sim_cell_t;
+
+static double sim_ocv(double soc)
+{
+	double pos = soc * (OCV_LUT.len - 1);
+	if (pos < 0)
+		pos = 0;
+	if (pos > OCV_LUT.len - 1)
+		pos = OCV_LUT.len - 1;
+
+	int index = pos;
+	if (index > OCV_LUT.len - 2)
+		index = OCV_LUT.len - 2;
+	return (OCV_LUT.y[index] + (OCV_LUT.y[index + 1] - OCV_LUT.y[index]) * (pos - index)) / 1000.0;
+}
+
+static void sim_step(sim_cell_t* cell, double current, double dt)
+{
+	cell->soc -= current * dt / CELL_CAPACITY;
+	cell->v_rc = (cell->tau * cell->v_rc + dt * CELL_R0 * cell->rc_gain * current) / (cell->tau + dt);
+}
+
+static double sim_voltage(const sim_cell_t* cell, double current)
+{
+	return sim_ocv(cell->soc) - CELL_R0 * current - cell->v_rc;
+}
+
+static double gauss()
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/**
+ * @brief Runs an endurance style profile (60 s at 80 A, 30 s at 10 A, 10 s of 20 A regen) from a
+ *      wrong initial SOC, checking the filter's error once it has had 10 minutes to settle
+ */
+static void track_profile(double tau, double rc_gain, double bias, double init_error, double max_rms,
+						  double max_error)
+{
+	sim_cell_t cell = { .soc = 0.95, .tau = tau, .rc_gain = rc_gain };
+	soc_ekf_t ekf;
+	soc_ekf_init(&ekf, cell.soc + init_error);
+
+	double charge = 0, worst = 0, square_sum = 0;
+	long samples = 0;
+
+	srand(1);
+	for (long step = 1; cell.soc > 0.05; step++) {
+		double time	   = step * SIM_DT;
+		double phase   = fmod(time, 100);
+		double current = phase < 60 ? 80 : phase < 90 ? 10 : -20;
+
+		sim_step(&cell, current, SIM_DT);
+		charge += (current + bias) * SIM_DT;
+
+		if (step % CORRECT_EVERY)
+			continue;
+
+		double voltage = sim_voltage(&cell, current) + 0.003 * gauss();
+		soc_ekf_predict(&ekf, charge, CORRECT_EVERY * SIM_DT, CELL_R0);
+		soc_ekf_correct(&ekf, voltage, current + bias, CELL_R0);
+		charge = 0;
+
+		if (time > 600) {
+			double error = fabs(ekf.soc - cell.soc);
+			if (error > worst)
+				worst = error;
+			square_sum += error * error;
+			samples++;
+		}
+	}
+
+	double rms = sqrt(square_sum / samples);
+	CHECK(rms <= max_rms && worst <= max_error,
+		  "tau %.0f s, RC x%.1f, bias %.1f A, start %+.2f: rms %.2f%% max %.2f%%", tau, rc_gain, bias,
+		  init_error, 100 * rms, 100 * worst);
+}
+
+static void test_tracks_profiles()
+{
+	/* The RC pair the filter assumes */
+	track_profile(30, 1.0, 0.3, 0.10, 0.01, 0.015);
+	track_profile(30, 1.0, 0.0, -0.10, 0.01, 0.015);
+
+	/* A slower, bigger RC pair than it assumes */
+	track_profile(60, 1.5, 0.3, 0.10, 0.01, 0.02);
+}
+
+/**
+ * @brief Holds current for each horizon and returns the cell's furthest voltage from where it
+ *      started, lowest while discharging and highest while charging
+ */
+static double furthest_voltage(double soc, double v_rc, double current, double time)
+{
+	/* The filter's own model, RC pair and all */
+	sim_cell_t cell = { .soc = soc, .v_rc = v_rc, .tau = 30, .rc_gain = 1 };
+	double furthest = sim_voltage(&cell, current);
+	for (double t = 0; t < time; t += 0.01) {
+		sim_step(&cell, current, 0.01);
+		double voltage = sim_voltage(&cell, current);
+		if (current > 0 ? voltage < furthest : voltage > furthest)
+			furthest = voltage;
+	}
+
+	return furthest;
+}
+
+/**
+ * @brief Holding the predicted limit currents for their horizons has to bring the simulated cell
+ *      to the voltage limits, not well past them and not well short of them
+ */
+static void test_limits_land_on_limits(double soc, double v_rc)
+{
+	const float times[] = { 2, 10, 30 };
+	const double floor = 2.95, ceiling = 3.75;
+	soc_ekf_t ekf;
+	soc_ekf_init(&ekf, soc);
+	ekf.v_rc = v_rc;
+
+	soc_ekf_horizon_t horizons[3];
+	float discharge[3], charge[3];
+	for (uint8_t h = 0; h < 3; h++) {
+		soc_ekf_horizon_init(&horizons[h], times[h]);
+	}
+	soc_ekf_current_limits(&ekf, CELL_R0, horizons, 3, floor, ceiling, discharge, charge);
+
+	for (uint8_t h = 0; h < 3; h++) {
+		double lowest  = furthest_voltage(soc, v_rc, discharge[h], times[h]);
+		double highest = furthest_voltage(soc, v_rc, -charge[h], times[h]);
+
+		/* Linearizing the OCV curve over the horizon costs a few mV either way */
+		CHECK(lowest > floor - 0.005 && lowest < floor + 0.010,
+			  "SOC %.2f, %.0f s at %.1f A bottoms out at %.4f V, floor %.3f V", soc, times[h], discharge[h], lowest,
+			  floor);
+		if (charge[h] > 0) {
+			CHECK(highest < ceiling + 0.005 && highest > ceiling - 0.010,
+				  "SOC %.2f, %.0f s at %.1f A charging tops out at %.4f V, ceiling %.3f V", soc, times[h], charge[h],
+				  highest, ceiling);
+		} else {
+			/* No charge at all is only right for a cell already at the ceiling */
+			CHECK(highest > ceiling - 0.010, "SOC %.2f at %.4f V got no charge, ceiling %.3f V", soc, highest, ceiling);
+		}
+	}
+}
+
+/**
+ * @brief A cell already past a limit gets nothing in that direction
+ */
+static void test_past_limits()
+{
+	soc_ekf_t ekf;
+	soc_ekf_horizon_t horizon;
+	float discharge, charge;
+	soc_ekf_horizon_init(&horizon, 10);
+
+	soc_ekf_init(&ekf, 0.0);
+	ekf.v_rc = 0.5f;
+	soc_ekf_current_limits(&ekf, CELL_R0, &horizon, 1, 2.95f, 3.75f, &discharge, &charge);
+	CHECK(discharge == 0 && charge > 0, "below the floor allowed %.1f A discharge, %.1f A charge", discharge, charge);
+
+	soc_ekf_init(&ekf, 1.0);
+	ekf.v_rc = -0.5f;
+	soc_ekf_current_limits(&ekf, CELL_R0, &horizon, 1, 2.95f, 3.75f, &discharge, &charge);
+	CHECK(charge == 0 && discharge > 0, "above the ceiling allowed %.1f A discharge, %.1f A charge", discharge, charge);
+}
+
+int main()
+{
+	test_tracks_profiles();
+	test_limits_land_on_limits(0.5, 0.0);
+	test_limits_land_on_limits(0.2, 0.05);
+	test_limits_land_on_limits(0.9, -0.02);
+	test_past_limits();
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,195 @@
+#include "host_test.h"
+#include "thermistor.h"
+#include <math.h>
+#include <stdbool.h>
+
+/* The lookup segment.c used before THERM_LUT, resistance in Ohms from -25 C up, one entry per degree */
+static const uint32_t VOLT_TEMP_CONV[106] = {
+157300, 148800, 140300, 131800, 123300, 114800, 108772, 102744, 96716, 90688, 84660, 80328, 75996, 71664, 67332,
+63000, 59860, 56720, 53580, 50440, 47300, 45004, 42708, 40412, 38116, 35820, 34124, 32428, 30732, 29036, 27340,
+26076, 24812, 23548, 22284, 21020, 20074, 19128, 18182, 17236, 16290, 15576, 14862, 14148, 13434, 12720, 12176,
+11632, 11088, 10544, 10000, 9584, 9168, 8753, 8337, 7921, 7600, 7279, 6957, 6636, 6315, 6065, 5816, 5566, 5317,
+5067, 4872, 4676, 4481, 4285, 4090, 3936, 3782, 3627, 3473, 3319, 3197, 3075, 2953, 2831, 2709, 2612, 2514, 2417,
+2319, 2222, 2144, 2066, 1988, 1910, 1832, 1769, 1706, 1644, 1581, 1518, 1467, 1416, 1366, 1315, 1264, 1223, 1181, 1140, 1098, 1057};
+
+#define MIN_TEMP -25
+#define MAX_TEMP 80
+
+/* ADC codes of the references the dividers could be driven from, the 5V GPIO3 ref and lower */
+static const uint16_t REF_CODES[] = { 50000, 32768, 20000 };
+
+static int8_t steinhart_est(uint16_t V)
+{
+	for (int i = -25; i < 80; i++) {
+		if (V > VOLT_TEMP_CONV[i + 25]) {
+			return i;
+		}
+	}
+
+	return 80;
+}
+
+/**
+ * @brief Divider resistance the old path computed, in floating point like it did
+ */
+static float old_resistance(uint16_t therm_code, uint16_t ref_code)
+{
+	return 10000 * (float)(((float)ref_code) / therm_code - 1);
+}
+
+/**
+ * @brief The old path end to end, only defined where the resistance fit the uint16_t it was
+ *      truncated to. Past the reference it went negative, which read as 0
+ */
+static int8_t old_degrees(uint16_t therm_code, uint16_t ref_code)
+{
+	float resistance = old_resistance(therm_code, ref_code);
+	return steinhart_est(resistance < 0 ? 0 : (uint16_t)resistance);
+}
+
+/**
+ * @brief Temperature in 0.1C interpolated straight from the old table, without any quantization
+ */
+static float exact_decidegrees(float resistance)
+{
+	if (resistance >= VOLT_TEMP_CONV[0])
+		return 10 * MIN_TEMP;
+
+	for (int i = 0; i < MAX_TEMP - MIN_TEMP; i++) {
+		if (resistance > VOLT_TEMP_CONV[i + 1]) {
+			float span = VOLT_TEMP_CONV[i] - VOLT_TEMP_CONV[i + 1];
+			return 10 * (MIN_TEMP + i + (VOLT_TEMP_CONV[i] - resistance) / span);
+		}
+	}
+
+	return 10 * MAX_TEMP;
+}
+
+/**
+ * @brief Wherever the old lookup was defined, the new one has to land on the same 1 C step. The
+ *      old one returned the warmer end of the step a reading fell in, so rounding can only take the
+ *      new one a degree cooler
+ */
+static void test_matches_old_lookup()
+{
+	for (size_t r = 0; r < sizeof(REF_CODES) / sizeof(REF_CODES[0]); r++) {
+		uint16_t ref = REF_CODES[r];
+		int failures = 0;
+
+		for (uint16_t code = 1; code < ref && failures < 5; code++) {
+			if (old_resistance(code, ref) > UINT16_MAX)
+				continue;
+
+			int8_t old	  = old_degrees(code, ref);
+			int8_t now	  = round_decidegrees(therm_decidegrees(code, ref));
+			bool in_step = now == old || now == old - 1;
+			CHECK(in_step, "code %u of %u read %d C, the old lookup %d C", code, ref, now, old);
+			failures += !in_step;
+		}
+	}
+}
+
+/**
+ * @brief Against the table itself, the new lookup is only off by its own quantization, including
+ *      the cold readings the old uint16_t resistance wrapped on
+ */
+static void test_tracks_table()
+{
+	for (size_t r = 0; r < sizeof(REF_CODES) / sizeof(REF_CODES[0]); r++) {
+		uint16_t ref = REF_CODES[r];
+		float worst	 = 0;
+		uint16_t worst_code = 0;
+
+		for (uint16_t code = 1; code < ref; code++) {
+			float error = therm_decidegrees(code, ref) - exact_decidegrees(old_resistance(code, ref));
+			if (fabsf(error) > worst) {
+				worst	   = fabsf(error);
+				worst_code = code;
+			}
+		}
+
+		CHECK(worst <= 2, "ref %u, code %u is %.1f tenths of a degree off of the table", ref, worst_code, worst);
+	}
+}
+
+/**
+ * @brief Readings off either end of the table hold its ends, and a reading at or past the ref is
+ *      as hot as the table goes, like the old lookup's
+ */
+static void test_clamps()
+{
+	for (size_t r = 0; r < sizeof(REF_CODES) / sizeof(REF_CODES[0]); r++) {
+		uint16_t ref = REF_CODES[r];
+
+		CHECK(therm_decidegrees(0, ref) == 10 * MIN_TEMP, "shorted thermistor read %d", therm_decidegrees(0, ref));
+
+		/* Colder than the table, a resistance past the first entry */
+		uint16_t cold = ref * 10000ull / (10000 + VOLT_TEMP_CONV[0]) - 1;
+		CHECK(therm_decidegrees(cold, ref) == 10 * MIN_TEMP, "ref %u, cold code %u read %d", ref, cold,
+			  therm_decidegrees(cold, ref));
+
+		/* Hotter than the table, a resistance under the last entry */
+		uint16_t hot = ref * 10000ull / (10000 + VOLT_TEMP_CONV[MAX_TEMP - MIN_TEMP]) + 1;
+		CHECK(therm_decidegrees(hot, ref) == 10 * MAX_TEMP, "ref %u, hot code %u read %d", ref, hot,
+			  therm_decidegrees(hot, ref));
+		CHECK(old_degrees(hot, ref) == MAX_TEMP, "ref %u, old lookup read hot code %u as %d", ref, hot,
+			  old_degrees(hot, ref));
+
+		const uint16_t past[] = { ref - 1, ref, ref + 1, UINT16_MAX };
+		for (size_t p = 0; p < sizeof(past) / sizeof(past[0]); p++) {
+			CHECK(therm_decidegrees(past[p], ref) == 10 * MAX_TEMP, "code %u of ref %u read %d", past[p], ref,
+				  therm_decidegrees(past[p], ref));
+			if (past[p] >= ref)
+				CHECK(old_degrees(past[p], ref) == MAX_TEMP, "old lookup read code %u of ref %u as %d",
+					  past[p], ref, old_degrees(past[p], ref));
+		}
+	}
+
+	CHECK(therm_decidegrees(0, 0) == 10 * MAX_TEMP, "a dead ref read %d", therm_decidegrees(0, 0));
+}
+
+#ifdef HOST_BENCH
+#include "host_bench.h"
+
+#define BENCH_REF 50000
+
+static void old_pass()
+{
+	int32_t sum = 0;
+	for (uint16_t code = 1; code <= BENCH_REF; code++)
+		sum += old_degrees(code, BENCH_REF);
+	bench_sink = sum;
+}
+
+static void lut_pass()
+{
+	int32_t sum = 0;
+	for (uint16_t code = 1; code <= BENCH_REF; code++)
+		sum += round_decidegrees(therm_decidegrees(code, BENCH_REF));
+	bench_sink = sum;
+}
+
+/**
+ * @brief Every code a divider off of the 5V ref can read, through each conversion
+ */
+static void bench()
+{
+	printf("thermistor conversion, per reading:\n");
+	double old = bench_run("float ratio and VOLT_TEMP_CONV scan", old_pass, 20, BENCH_REF);
+	double now = bench_run("therm_decidegrees and round_decidegrees", lut_pass, 20, BENCH_REF);
+	BENCH_SPEEDUP("speedup", old, now);
+}
+#endif
+
+int main()
+{
+	test_matches_old_lookup();
+	test_tracks_table();
+	test_clamps();
+
+#ifdef HOST_BENCH
+	bench();
+#endif
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,80 @@
+#include "host_test.h"
+#include "thermal_model.h"
+#include <math.h>
+
+#define SEGMENT_RESISTANCE 0.038 /* Ohm, 20 cell groups at the 1.9 mOhm table floor */
+
+/**
+ * @brief A burst of current with thermistors that lag the cells by 20 s and only get read every
+ *      3 s. While the cells heat, the model has to be closer to the truth than the thermistors are
+ */
+static void test_leads_thermistors()
+{
+	thermal_model_t model;
+	thermal_init(&model, 25);
+
+	double truth = 25, thermistor = 25;
+	double dt	 = 0.01;
+	for (int step = 0; step < 4000; step++) {
+		double current = 150;
+		double heat	   = current * current * SEGMENT_RESISTANCE;
+
+		/* Same capacity and natural conductance as the model */
+		truth += dt * (heat - 2 * (truth - 25)) / 12000;
+		thermistor += dt * (truth - thermistor) / 20;
+
+		thermal_predict(&model, heat, 0, dt);
+		if (step % 300 == 0)
+			thermal_correct(&model, thermistor);
+	}
+
+	CHECK(fabs(model.temp - truth) < fabs(thermistor - truth),
+		  "after 40 s at 150 A, model %.2f C, thermistors %.2f C, cells %.2f C", model.temp, thermistor, truth);
+	CHECK(model.temp > thermistor, "model %.2f C fell behind the thermistors %.2f C", model.temp, thermistor);
+}
+
+/**
+ * @brief With no readings, the model has to settle where heat in matches heat out
+ */
+static void test_settles()
+{
+	thermal_model_t model;
+	thermal_init(&model, 25);
+
+	/* Long steps are exact, so one 10 hour step lands on the same place as many short ones */
+	double heat = 24;
+	thermal_predict(&model, heat, 0, 36000);
+	CHECK(fabs(model.temp - (25 + heat / 2)) < 0.1, "settled at %.2f C with the fan off", model.temp);
+
+	thermal_init(&model, 25);
+	thermal_predict(&model, heat, 1, 36000);
+	CHECK(fabs(model.temp - (25 + heat / 12)) < 0.1, "settled at %.2f C with the fan on", model.temp);
+}
+
+/**
+ * @brief Readings pull the model in, and its variance can only grow between them
+ */
+static void test_corrects()
+{
+	thermal_model_t model;
+	thermal_init(&model, 25);
+
+	float before = model.p;
+	thermal_predict(&model, 0, 0, 10);
+	CHECK(model.p > before, "variance didn't grow over a prediction");
+
+	for (int reading = 0; reading < 20; reading++) {
+		thermal_predict(&model, 0, 0, 1);
+		thermal_correct(&model, 35);
+	}
+	CHECK(fabsf(model.temp - 35) < 1, "20 readings of 35 C left the model at %.2f C", model.temp);
+}
+
+int main()
+{
+	test_leads_thermistors();
+	test_settles();
+	test_corrects();
+
+	return HOST_TEST_RESULT();
+}